@@ -0,0 +1,293 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "rendercheck.h"
+
+int enabled_benchmarks = 0;
+
+/* Number of iterations per trial a benchmark starts with. */
+int bench_iterations = 100;
+
+double
+get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Most trials of a benchmark that are kept, and how many are needed before
+ * the confidence interval means anything.
+ */
+#define MAX_TRIALS	100
+#define MIN_TRIALS	3
+
+/* Trials run and thrown away before measuring, trials measured at most, the
+ * shortest a trial may take, in seconds, and the relative half-width of the
+ * 95% confidence interval at which measuring stops early.
+ */
+int bench_warmup_trials = 1;
+int bench_trials = 10;
+double bench_min_time = 0.01;
+double bench_precision = 0.02;
+
+static int
+compare_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+static double
+median(const double *t, int n)
+{
+	double sorted[MAX_TRIALS];
+
+	memcpy(sorted, t, sizeof(double) * n);
+	qsort(sorted, n, sizeof(double), compare_double);
+	if (n % 2)
+		return sorted[n / 2];
+	return (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+/* Two-sided 95% critical values of Student's t distribution, by degrees of
+ * freedom.
+ */
+static double
+t_critical(int df)
+{
+	static const double t[] = {
+		0, 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+		2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110,
+		2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056,
+		2.052, 2.048, 2.045, 2.042,
+	};
+
+	if (df < (int)ARRAY_SIZE(t))
+		return t[df];
+	return 1.96;
+}
+
+/* Times one trial of iterations iterations of desc->func, from a
+ * synchronized start until the server has processed everything.
+ */
+static double
+time_trial(Display *dpy, const struct bench_desc *desc, int iterations)
+{
+	double start;
+
+	XSync(dpy, False);
+	start = get_time();
+	desc->func(dpy, desc->data, iterations);
+	XSync(dpy, False);
+	return get_time() - start;
+}
+
+/* Drops the trials further from the median than 3 scaled median absolute
+ * deviations, which would be 3 standard deviations for normally distributed
+ * timings.  Returns the number of trials kept.
+ */
+static int
+reject_outliers(double *t, int n)
+{
+	double m = median(t, n), dev[MAX_TRIALS], mad;
+	int i, kept = 0;
+
+	for (i = 0; i < n; i++)
+		dev[i] = fabs(t[i] - m);
+	mad = median(dev, n) * 1.4826;
+	if (mad == 0)
+		return n;
+
+	for (i = 0; i < n; i++) {
+		if (dev[i] <= 3 * mad)
+			t[kept++] = t[i];
+	}
+	return kept;
+}
+
+/* Benchmarks desc->func and prints the throughput.
+ *
+ * The iteration count starts at desc->iterations and is scaled up until a
+ * trial takes at least bench_min_time, during the bench_warmup_trials
+ * untimed trials.  At least one untimed trial is needed to check the count,
+ * so one is run even if bench_warmup_trials is 0.  Then up to bench_trials
+ * trials are measured, stopping early once the 95% confidence interval of the
+ * mean time is within bench_precision of it, after outliers are rejected.
+ *
+ * Returns the mean time taken per iteration, in seconds.
+ */
+double
+run_benchmark(Display *dpy, const struct bench_desc *desc)
+{
+	double t[MAX_TRIALS], kept[MAX_TRIALS];
+	double elapsed, mean = 0, med, var, half = 0, per_iter;
+	int iterations = desc->iterations, warmups = 0;
+	int i, n = 0, num_kept = 0;
+
+	for (;;) {
+		elapsed = time_trial(dpy, desc, iterations);
+		warmups++;
+		if (elapsed < bench_min_time && iterations < INT_MAX / 2) {
+			double scale = bench_min_time / max(elapsed, 1e-6);
+
+			iterations = min((double)INT_MAX / 2,
+			    ceil(iterations * min(scale * 1.1, 100.)));
+			continue;
+		}
+		if (warmups >= bench_warmup_trials)
+			break;
+	}
+
+	cpu_tuple_begin();
+	perf_tuple_begin();
+	while (n < min(bench_trials, MAX_TRIALS)) {
+		t[n] = time_trial(dpy, desc, iterations) / iterations;
+		latency_record(t[n] * iterations);
+		n++;
+
+		memcpy(kept, t, sizeof(double) * n);
+		num_kept = reject_outliers(kept, n);
+
+		mean = 0;
+		for (i = 0; i < num_kept; i++)
+			mean += kept[i];
+		mean /= num_kept;
+
+		var = 0;
+		for (i = 0; i < num_kept; i++)
+			var += (kept[i] - mean) * (kept[i] - mean);
+		half = 0;
+		if (num_kept > 1) {
+			var /= num_kept - 1;
+			half = t_critical(num_kept - 1) * sqrt(var / num_kept);
+		}
+
+		if (num_kept >= MIN_TRIALS && half <= bench_precision * mean)
+			break;
+	}
+	med = median(kept, num_kept);
+	per_iter = mean;
+
+	printf("%-50s %12.2f %s/s", desc->name, desc->units / per_iter,
+	       desc->unit_name);
+	results_record(desc->name, desc->units / per_iter, desc->unit_name);
+	if (desc->pixels != 0)
+		printf(" %9.2f Mpixels/s", desc->pixels / per_iter / 1e6);
+	printf(" %10.2f us/iter", per_iter * 1e6);
+	if (n > 1) {
+		/* With fewer than two trials left there is no interval. */
+		printf(" (median %.2f", med * 1e6);
+		if (num_kept > 1)
+			printf(", 95%% CI +/- %.1f%%", half / mean * 100);
+		printf(", %d trials", n);
+		if (num_kept != n)
+			printf(", %d outliers", n - num_kept);
+		printf(")");
+	}
+	printf("\n");
+	cpu_tuple_end();
+	perf_tuple_end();
+
+	return per_iter;
+}
+
+/* How far above the steady-state cost an iteration may be and still count as
+ * warmed up, as a fraction of that cost.
+ */
+#define WARMUP_TOLERANCE 0.5
+
+/* Times each of iterations single iterations of desc->func separately, for
+ * seeing how the server's cost for the same operation on the same pixmaps
+ * changes as it migrates them.  Prints the per-iteration curve, the
+ * iteration from which the cost stays near the median of the last half, the
+ * time spent above that cost before then, and how many times the cost went
+ * back up after first settling, which suggests the pixmaps are being
+ * migrated back and forth.  Returns the steady-state time, in seconds.
+ */
+double
+run_warmup(Display *dpy, const struct bench_desc *desc, int iterations)
+{
+	double *t, *sorted, steady, limit, start, warmup_cost = 0;
+	int i, steady_iter = 0, relapses = 0;
+	bool settled = false, slow = true;
+
+	t = malloc(sizeof(double) * iterations);
+	sorted = malloc(sizeof(double) * iterations);
+	if (t == NULL || sorted == NULL)
+		errx(1, "malloc error");
+
+	for (i = 0; i < iterations; i++) {
+		XSync(dpy, False);
+		start = get_time();
+		desc->func(dpy, desc->data, 1);
+		XSync(dpy, False);
+		t[i] = get_time() - start;
+		latency_record(t[i]);
+	}
+
+	memcpy(sorted, t + iterations / 2,
+	       sizeof(double) * (iterations - iterations / 2));
+	qsort(sorted, iterations - iterations / 2, sizeof(double),
+	      compare_double);
+	steady = sorted[(iterations - iterations / 2) / 2];
+	limit = steady * (1 + WARMUP_TOLERANCE);
+
+	for (i = 0; i < iterations; i++) {
+		if (t[i] > limit) {
+			if (!slow && settled)
+				relapses++;
+			slow = true;
+			steady_iter = i + 1;
+		} else {
+			slow = false;
+			settled = true;
+		}
+	}
+	for (i = 0; i < steady_iter; i++)
+		warmup_cost += t[i] - steady;
+
+	printf("%-50s first %.2f us, steady %.2f us from iteration %d, "
+	       "%.2f us warm-up\n", desc->name, t[0] * 1e6, steady * 1e6,
+	       steady_iter, warmup_cost * 1e6);
+	for (i = 0; i < iterations; i++) {
+		printf("%s%9.2f", i % 8 == 0 ? "  " : " ", t[i] * 1e6);
+		if (i % 8 == 7 || i == iterations - 1)
+			printf("\n");
+	}
+	results_record(desc->name, desc->units / steady, desc->unit_name);
+	if (relapses != 0)
+		printf("  cost went back up %d times after settling\n",
+		       relapses);
+
+	free(t);
+	free(sorted);
+
+	return steady;
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "rendercheck.h"
+
+/* With --server-pid, the CPU time used by the X server, read from
+ * /proc/<pid>/stat, and by rendercheck itself, from getrusage(), is sampled
+ * around each test group and benchmark.  Whatever wall-clock time is left
+ * over was spent waiting, on the transport or on the GPU.
+ */
+
+/* 0 when not accounting, -1 for the Xvfb serving this job's display. */
+pid_t server_pid = 0;
+
+struct cpu_times {
+	double wall, client, server;
+};
+
+struct cpu_group {
+	const char *name;
+	struct cpu_times total;
+};
+
+static struct cpu_group *groups;
+static int num_groups;
+static struct cpu_group *current;
+static struct cpu_times group_start, tuple_start;
+static double clock_tick;
+
+static double
+server_time(void)
+{
+	unsigned long utime, stime;
+	char path[32], buf[1024], *p;
+	FILE *file;
+	size_t len;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)server_pid);
+	file = fopen(path, "r");
+	if (file == NULL)
+		errx(1, "%s: %s", path, strerror(errno));
+	len = fread(buf, 1, sizeof(buf) - 1, file);
+	fclose(file);
+	buf[len] = '\0';
+
+	/* The command name may contain spaces, so start after it.  utime and
+	 * stime are the 12th and 13th fields after it.
+	 */
+	p = strrchr(buf, ')');
+	if (p == NULL || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u "
+				"%*u %*u %lu %lu", &utime, &stime) != 2)
+		errx(1, "%s: unexpected format", path);
+
+	return (utime + stime) * clock_tick;
+}
+
+static void
+sample(struct cpu_times *t)
+{
+	struct rusage usage;
+
+	t->wall = get_time();
+	getrusage(RUSAGE_SELF, &usage);
+	t->client = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	t->server = server_time();
+}
+
+static struct cpu_group *
+find_group(const char *name)
+{
+	struct cpu_group *g;
+	int i;
+
+	for (i = 0; i < num_groups; i++) {
+		if (strcmp(groups[i].name, name) == 0)
+			return &groups[i];
+	}
+
+	groups = realloc(groups, sizeof(*groups) * (num_groups + 1));
+	if (groups == NULL)
+		errx(1, "realloc error");
+	g = &groups[num_groups++];
+	memset(g, 0, sizeof(*g));
+	g->name = name;
+	return g;
+}
+
+/* Works out the server to account for, now that the display is known. */
+void
+cpu_init(const char *display)
+{
+	if (server_pid == 0)
+		return;
+
+	if (server_pid < 0) {
+		server_pid = xvfb_pid(display);
+		if (server_pid <= 0)
+			errx(1, "--server-pid xvfb needs --xvfb");
+	}
+	clock_tick = 1.0 / sysconf(_SC_CLK_TCK);
+
+	printf("Accounting CPU time of server pid %d\n", (int)server_pid);
+}
+
+/* Charges the time since the last call to the previous group, and starts
+ * charging the named one.
+ */
+void
+cpu_group(const char *name)
+{
+	struct cpu_times now;
+
+	if (server_pid == 0)
+		return;
+
+	sample(&now);
+	if (current != NULL) {
+		current->total.wall += now.wall - group_start.wall;
+		current->total.client += now.client - group_start.client;
+		current->total.server += now.server - group_start.server;
+	}
+	group_start = now;
+	current = NULL;
+	if (name != NULL)
+		current = find_group(name);
+}
+
+static void
+print_times(const struct cpu_times *t)
+{
+	double idle = max(t->wall - t->server - t->client, 0);
+
+	printf("%9.1f %9.1f %9.1f %9.1f", t->wall * 1e3, t->server * 1e3,
+	       t->client * 1e3, idle * 1e3);
+}
+
+void
+cpu_tuple_begin(void)
+{
+	if (server_pid != 0)
+		sample(&tuple_start);
+}
+
+/* Prints the time taken since cpu_tuple_begin(), split up. */
+void
+cpu_tuple_end(void)
+{
+	struct cpu_times now;
+
+	if (server_pid == 0)
+		return;
+
+	sample(&now);
+	now.wall -= tuple_start.wall;
+	now.client -= tuple_start.client;
+	now.server -= tuple_start.server;
+	printf("  wall/server/client/idle ms: ");
+	print_times(&now);
+	printf("\n");
+}
+
+/* Hands the group totals of a --jobs child to the parent, which adds up those
+ * of all the children with cpu_receive() before printing them.
+ */
+void
+cpu_send(void)
+{
+	int i;
+
+	if (current != NULL)
+		cpu_group(NULL);
+
+	shard_write(&num_groups, sizeof(num_groups));
+	for (i = 0; i < num_groups; i++) {
+		shard_write_string(groups[i].name);
+		shard_write(&groups[i].total, sizeof(groups[i].total));
+	}
+}
+
+bool
+cpu_receive(int fd)
+{
+	int i, n;
+
+	if (!shard_read(fd, &n, sizeof(n)))
+		return false;
+	for (i = 0; i < n; i++) {
+		struct cpu_times received;
+		struct cpu_group *g;
+		char *name = shard_read_string(fd);
+
+		if (name == NULL)
+			return false;
+		if (!shard_read(fd, &received, sizeof(received))) {
+			free(name);
+			return false;
+		}
+
+		g = find_group(name);
+		if (g->name != name)
+			free(name);
+		g->total.wall += received.wall;
+		g->total.client += received.client;
+		g->total.server += received.server;
+	}
+	return true;
+}
+
+void
+cpu_report(void)
+{
+	int i;
+
+	if (server_pid == 0)
+		return;
+
+	/* The parent of --jobs children has no group of its own open. */
+	if (current != NULL)
+		cpu_group(NULL);
+	printf("CPU time (ms):             wall    server    client      idle\n");
+	for (i = 0; i < num_groups; i++) {
+		printf("%-20s ", groups[i].name);
+		print_times(&groups[i].total);
+		printf("\n");
+	}
+
+	free(groups);
+	groups = NULL;
+	num_groups = 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "rendercheck.h"
+
+/* With --latency, each batch of rendering requests is timed from the point it
+ * is flushed until the server has processed it, minus the time of a no-op
+ * round trip, and the results are collected in a histogram per test group.
+ */
+
+bool latency_mode = false;
+
+/* Buckets are a quarter of an octave wide, starting at LATENCY_MIN seconds. */
+#define LATENCY_MIN		1e-7
+#define BUCKETS_PER_OCTAVE	4
+#define NUM_BUCKETS		(32 * BUCKETS_PER_OCTAVE)
+
+/* Number of round trips averaged for the baseline. */
+#define BASELINE_SAMPLES	100
+
+struct latency_histogram {
+	const char *name;
+	int buckets[NUM_BUCKETS];
+	int count;
+	double max;
+};
+
+static struct latency_histogram *groups;
+static int num_groups;
+static struct latency_histogram *current;
+static double baseline;
+
+/* Measures the no-op round trip time that is subtracted from every sample. */
+void
+latency_init(Display *dpy)
+{
+	Window focus;
+	double start;
+	int i, revert;
+
+	XSync(dpy, False);
+	start = get_time();
+	for (i = 0; i < BASELINE_SAMPLES; i++)
+		XGetInputFocus(dpy, &focus, &revert);
+	baseline = (get_time() - start) / BASELINE_SAMPLES;
+
+	printf("Round trip baseline: %.1f us\n", baseline * 1e6);
+}
+
+static struct latency_histogram *
+find_group(const char *name)
+{
+	struct latency_histogram *h;
+	int i;
+
+	for (i = 0; i < num_groups; i++) {
+		if (strcmp(groups[i].name, name) == 0)
+			return &groups[i];
+	}
+
+	groups = realloc(groups, sizeof(*groups) * (num_groups + 1));
+	if (groups == NULL)
+		errx(1, "realloc error");
+	h = &groups[num_groups++];
+	memset(h, 0, sizeof(*h));
+	h->name = name;
+	return h;
+}
+
+/* Directs the following samples to the histogram of the named group. */
+void
+latency_group(const char *name)
+{
+	if (!latency_mode)
+		return;
+
+	current = find_group(name);
+}
+
+/* Records a batch that took the given time, including one round trip. */
+void
+latency_record(double seconds)
+{
+	int bucket = 0;
+
+	if (!latency_mode || current == NULL)
+		return;
+
+	seconds = max(seconds - baseline, 0);
+	if (seconds > LATENCY_MIN)
+		bucket = log2(seconds / LATENCY_MIN) * BUCKETS_PER_OCTAVE;
+	bucket = min(bucket, NUM_BUCKETS - 1);
+
+	current->buckets[bucket]++;
+	current->count++;
+	current->max = max(current->max, seconds);
+}
+
+/* Waits for the server to process the requests sent so far, timing it as one
+ * batch.
+ */
+void
+latency_sync(Display *dpy)
+{
+	double start;
+
+	if (!latency_mode)
+		return;
+
+	start = get_time();
+	XSync(dpy, False);
+	latency_record(get_time() - start);
+}
+
+/* Hands the histograms of a --jobs child to the parent, which merges those of
+ * all the children with latency_receive() before printing them.
+ */
+void
+latency_send(void)
+{
+	int i;
+
+	shard_write(&num_groups, sizeof(num_groups));
+	for (i = 0; i < num_groups; i++) {
+		struct latency_histogram *h = &groups[i];
+
+		shard_write_string(h->name);
+		shard_write(h->buckets, sizeof(h->buckets));
+		shard_write(&h->count, sizeof(h->count));
+		shard_write(&h->max, sizeof(h->max));
+	}
+}
+
+bool
+latency_receive(int fd)
+{
+	int i, j, n;
+
+	if (!shard_read(fd, &n, sizeof(n)))
+		return false;
+	for (i = 0; i < n; i++) {
+		struct latency_histogram received, *h;
+		char *name = shard_read_string(fd);
+
+		if (name == NULL)
+			return false;
+		if (!shard_read(fd, received.buckets,
+				sizeof(received.buckets)) ||
+		    !shard_read(fd, &received.count, sizeof(received.count)) ||
+		    !shard_read(fd, &received.max, sizeof(received.max))) {
+			free(name);
+			return false;
+		}
+
+		h = find_group(name);
+		if (h->name != name)
+			free(name);
+		for (j = 0; j < NUM_BUCKETS; j++)
+			h->buckets[j] += received.buckets[j];
+		h->count += received.count;
+		h->max = max(h->max, received.max);
+	}
+	return true;
+}
+
+/* Returns the upper edge of the bucket holding the given fraction of the
+ * samples, which is within a quarter octave of the real percentile.
+ */
+static double
+percentile(const struct latency_histogram *h, double fraction)
+{
+	int i, seen = 0;
+
+	for (i = 0; i < NUM_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= fraction * h->count)
+			break;
+	}
+	return min(LATENCY_MIN * exp2((i + 1.0) / BUCKETS_PER_OCTAVE),
+		   h->max);
+}
+
+void
+latency_report(void)
+{
+	int i;
+
+	if (!latency_mode)
+		return;
+
+	printf("Batch latency (us):   samples       p50       p90       p99"
+	       "       max\n");
+	for (i = 0; i < num_groups; i++) {
+		struct latency_histogram *h = &groups[i];
+
+		if (h->count == 0)
+			continue;
+		printf("%-20s %9d %9.1f %9.1f %9.1f %9.1f\n", h->name, h->count,
+		       percentile(h, 0.5) * 1e6, percentile(h, 0.9) * 1e6,
+		       percentile(h, 0.99) * 1e6, h->max * 1e6);
+	}
+
+	free(groups);
+	groups = NULL;
+	num_groups = 0;
+	current = NULL;
+}
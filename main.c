@@ -41,6 +41,8 @@ int pixmap_move_iter = 1;
 int win_width = 40;
 int win_height = 200;
 
+static int is_sync = false;
+
 int
 bit_count(int i)
 {
@@ -124,6 +126,19 @@ struct {
     {0, NULL}
 };
 
+struct {
+    int flag;
+    const char *name;
+} available_benchmarks[] = {
+    {BENCH_COMPOSITE, "composite"},
+    {BENCH_SIZES, "sizes"},
+    {BENCH_TRIANGLES, "triangles"},
+    {BENCH_GRADIENTS, "gradients"},
+    {BENCH_REPEAT, "repeat"},
+    {BENCH_WARMUP, "warmup"},
+    {0, NULL}
+};
+
 static void
 print_test_separator(int i)
 {
@@ -157,28 +172,129 @@ void print_tests(FILE *file, int tests) {
         fprintf(file, "\n");
 }
 
+static void
+print_benchmarks(FILE *file)
+{
+    int i;
+
+    for (i = 0; available_benchmarks[i].name; i++) {
+	print_test_separator(i);
+	fprintf(file, "%s", available_benchmarks[i].name);
+    }
+    for_each_bench(bench) {
+	print_test_separator(i++);
+	fprintf(file, "%s", bench->arg_name);
+    }
+    fprintf(file, "\n");
+}
+
 _X_NORETURN
 static void
 usage (char *program)
 {
     fprintf(stderr, "usage: %s [-d|--display display] [-v|--verbose]\n"
 	"\t[-t test1,test2,...] [-o op1,op2,...] [-f format1,format2,...]\n"
-	"\t[--sync] [--minimalrendering] [--version]\n"
+	"\t[-j|--jobs jobs] [--xvfb servers] [--sync] [--minimalrendering]\n"
+	"\t[-b|--benchmark all|bench1,bench2,...] [--bench-iterations n]\n"
+	"\t[--warmup n] [--trials n] [--min-time ms] [--precision percent]\n"
+	"\t[--latency] [--results file] [--compare file [--threshold percent]]\n"
+	"\t[--record file] [--replay file [--paced]] [--scene file1,file2,...]\n"
+	"\t[--server-pid pid|xvfb] [--perf]\n"
+	"\t[--version]\n"
 	"Available tests:\n", program);
     print_tests(stderr, ~0);
+    fprintf(stderr, "Available benchmarks:\n");
+    print_benchmarks(stderr);
     exit(1);
 }
 
-int main(int argc, char **argv)
+/* Connects to the display, sets up the window and runs the tests on it.
+ * Returns the exit status for the program.
+ */
+static int
+run_tests(const char *display)
 {
 	Display *dpy;
 	XEvent ev;
-	int i, o, maj, min, ret = 1;
-	static int is_sync = false, print_version = false;
-	static int longopt_minimalrendering = 0;
+	int i, maj, min, ret = 1;
+	int win_x, win_y;
 	XWindowAttributes a;
 	XSetWindowAttributes as;
 	picture_info window;
+	char *format;
+
+	dpy = XOpenDisplay(display);
+	if (dpy == NULL)
+		errx(1, "Couldn't open display.");
+	if (is_sync)
+		XSynchronize(dpy, 1);
+
+	if (!XRenderQueryExtension(dpy, &i, &i))
+		errx(1, "Render extension missing.");
+
+	XRenderQueryVersion(dpy, &maj, &min);
+	if (maj != 0 || min < 1)
+		errx(1, "Render extension version too low (%d.%d).", maj, min);
+
+	printf("Render extension version %d.%d\n", maj, min);
+
+	trace_init(dpy);
+	cpu_init(display);
+	perf_init();
+
+	/* Conjoint/Disjoint were added in version 0.2, so disable those ops if
+	 * the server doesn't support them.
+	 */
+	if (min < 2) {
+		printf("Server doesn't support conjoint/disjoint ops, disabling.\n");
+		num_ops = PictOpSaturate;
+	}
+
+	shard_window_position(dpy, &win_x, &win_y);
+	window.d = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy),
+	    win_x, win_y, win_width, win_height, 0, 0, WhitePixel(dpy, 0));
+
+	as.override_redirect = True;
+	XChangeWindowAttributes(dpy, window.d, CWOverrideRedirect, &as);
+
+	XGetWindowAttributes(dpy, window.d, &a);
+	window.format = XRenderFindVisualFormat(dpy, a.visual);
+	window.pict = XRenderCreatePicture(dpy, window.d,
+	    window.format, 0, NULL);
+	describe_format(&format, NULL, window.format);
+	printf("Window format: %s\n", format);
+	asprintf(&window.name, "%s window", format);
+	free(format);
+	XSelectInput(dpy, window.d, ExposureMask);
+	XMapWindow(dpy, window.d);
+
+	while (XNextEvent(dpy, &ev) == 0) {
+		if (ev.type == Expose && !ev.xexpose.count) {
+			if (do_tests(dpy, &window))
+				ret = 0;
+			else
+				ret = 1;
+			break;
+		}
+	}
+
+	free(window.name);
+
+	trace_fini(dpy);
+        XCloseDisplay(dpy);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int i, o, ret = 1;
+	static int print_version = false;
+	static int longopt_minimalrendering = 0;
+	static int longopt_latency = 0;
+	static int longopt_paced = 0;
+	static int longopt_perf = 0;
+	int xvfb_servers = 0;
+	bool tests_selected = false;
 	char *display = NULL;
 	char *test_name, *format, *opname, *nextname;
 
@@ -188,6 +304,24 @@ int main(int argc, char **argv)
 		{ "formats",	required_argument,	NULL,	'f' },
 		{ "tests",	required_argument,	NULL,	't' },
 		{ "ops",	required_argument,	NULL,	'o' },
+		{ "jobs",	required_argument,	NULL,	'j' },
+		{ "xvfb",	required_argument,	NULL,	'X' },
+		{ "benchmark",	required_argument,	NULL,	'b' },
+		{ "bench-iterations", required_argument, NULL,	'I' },
+		{ "warmup",	required_argument,	NULL,	'W' },
+		{ "trials",	required_argument,	NULL,	'N' },
+		{ "min-time",	required_argument,	NULL,	'M' },
+		{ "precision",	required_argument,	NULL,	'P' },
+		{ "latency",	no_argument,	&longopt_latency, true },
+		{ "results",	required_argument,	NULL,	'R' },
+		{ "compare",	required_argument,	NULL,	'C' },
+		{ "threshold",	required_argument,	NULL,	'T' },
+		{ "record",	required_argument,	NULL,	'E' },
+		{ "replay",	required_argument,	NULL,	'Y' },
+		{ "paced",	no_argument,	&longopt_paced, true },
+		{ "scene",	required_argument,	NULL,	'S' },
+		{ "server-pid",	required_argument,	NULL,	'p' },
+		{ "perf",	no_argument,	&longopt_perf, true },
 		{ "verbose",	no_argument,		NULL,	'v' },
 		{ "sync",	no_argument,		&is_sync, true},
 		{ "minimalrendering", no_argument,
@@ -196,7 +330,7 @@ int main(int argc, char **argv)
 		{ NULL,		0,			NULL,	0 }
 	};
 
-	while ((o = getopt_long(argc, argv, "d:i:f:t:o:v", longopts, NULL)) != -1) {
+	while ((o = getopt_long(argc, argv, "d:i:f:t:o:j:b:v", longopts, NULL)) != -1) {
 		switch (o) {
 		case 'd':
 			display = optarg;
@@ -204,6 +338,100 @@ int main(int argc, char **argv)
 		case 'i':
 			pixmap_move_iter = atoi(optarg);
 			break;
+		case 'j':
+			num_jobs = atoi(optarg);
+			if (num_jobs < 1)
+				usage(argv[0]);
+			break;
+		case 'X':
+			xvfb_servers = atoi(optarg);
+			if (xvfb_servers < 1)
+				usage(argv[0]);
+			break;
+		case 'b':
+			nextname = optarg;
+			while ((test_name = strsep(&nextname, ",")) != NULL) {
+				bool found = false;
+
+				if (strcmp(test_name, "all") == 0) {
+					enabled_benchmarks = ~0;
+					continue;
+				}
+				for (i = 0; available_benchmarks[i].name; i++) {
+					if (strcmp(test_name,
+						   available_benchmarks[i].name) == 0) {
+						enabled_benchmarks |=
+						    available_benchmarks[i].flag;
+						found = true;
+						break;
+					}
+				}
+				for_each_bench(bench) {
+					if (strcmp(test_name,
+						   bench->arg_name) == 0) {
+						enabled_benchmarks |= bench->bit;
+						found = true;
+						break;
+					}
+				}
+				if (!found)
+					usage(argv[0]);
+			}
+			break;
+		case 'I':
+			bench_iterations = atoi(optarg);
+			if (bench_iterations < 1)
+				usage(argv[0]);
+			break;
+		case 'W':
+			bench_warmup_trials = atoi(optarg);
+			if (bench_warmup_trials < 0)
+				usage(argv[0]);
+			break;
+		case 'N':
+			bench_trials = atoi(optarg);
+			if (bench_trials < 1)
+				usage(argv[0]);
+			break;
+		case 'M':
+			bench_min_time = atof(optarg) / 1000;
+			if (bench_min_time < 0)
+				usage(argv[0]);
+			break;
+		case 'P':
+			bench_precision = atof(optarg) / 100;
+			if (bench_precision < 0)
+				usage(argv[0]);
+			break;
+		case 'R':
+			results_path = optarg;
+			break;
+		case 'C':
+			compare_path = optarg;
+			break;
+		case 'T':
+			compare_threshold = atof(optarg);
+			if (compare_threshold < 0)
+				usage(argv[0]);
+			break;
+		case 'E':
+			record_path = optarg;
+			break;
+		case 'Y':
+			replay_path = optarg;
+			break;
+		case 'p':
+			if (strcmp(optarg, "xvfb") == 0)
+				server_pid = -1;
+			else
+				server_pid = atoi(optarg);
+			if (server_pid == 0)
+				usage(argv[0]);
+			break;
+		case 'S':
+			scene_paths = optarg;
+			enabled_benchmarks |= BENCH_SCENES;
+			break;
 		case 'o':
 			for (i = 0; i < num_ops; i++)
 				ops[i].disabled = true;
@@ -249,6 +477,7 @@ int main(int argc, char **argv)
 
 			/* disable all tests */
 			enabled_tests = 0;
+			tests_selected = true;
 
 			while ((test_name = strsep(&nextname, ",")) != NULL) {
 				int i;
@@ -283,8 +512,17 @@ int main(int argc, char **argv)
 			break;
 		}
 	}
+	if (optind < argc)
+		usage(argv[0]);
 
 	minimalrendering = longopt_minimalrendering;
+	latency_mode = longopt_latency;
+	replay_paced = longopt_paced;
+	perf_mode = longopt_perf;
+
+	/* Benchmarking replaces the tests unless some were asked for too. */
+	if (enabled_benchmarks && !tests_selected)
+		enabled_tests = 0;
 
 	/* Print the version string.  Bail out if --version was requested and
 	 * continue otherwise.
@@ -293,46 +531,6 @@ int main(int argc, char **argv)
 	if (print_version)
 		return 0;
 
-	dpy = XOpenDisplay(display);
-	if (dpy == NULL)
-		errx(1, "Couldn't open display.");
-	if (is_sync)
-		XSynchronize(dpy, 1);
-
-	if (!XRenderQueryExtension(dpy, &i, &i))
-		errx(1, "Render extension missing.");
-
-	XRenderQueryVersion(dpy, &maj, &min);
-	if (maj != 0 || min < 1)
-		errx(1, "Render extension version too low (%d.%d).", maj, min);
-
-	printf("Render extension version %d.%d\n", maj, min);
-
-	/* Conjoint/Disjoint were added in version 0.2, so disable those ops if
-	 * the server doesn't support them.
-	 */
-	if (min < 2) {
-		printf("Server doesn't support conjoint/disjoint ops, disabling.\n");
-		num_ops = PictOpSaturate;
-	}
-
-	window.d = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0,
-	    win_width, win_height, 0, 0, WhitePixel(dpy, 0));
-
-	as.override_redirect = True;
-	XChangeWindowAttributes(dpy, window.d, CWOverrideRedirect, &as);
-
-	XGetWindowAttributes(dpy, window.d, &a);
-	window.format = XRenderFindVisualFormat(dpy, a.visual);
-	window.pict = XRenderCreatePicture(dpy, window.d,
-	    window.format, 0, NULL);
-	describe_format(&format, NULL, window.format);
-	printf("Window format: %s\n", format);
-	asprintf(&window.name, "%s window", format);
-	free(format);
-	XSelectInput(dpy, window.d, ExposureMask);
-	XMapWindow(dpy, window.d);
-
 	/* We have to premultiply the alpha into the r, g, b values of the
 	 * sample colors.  Render colors are premultiplied with alpha, so r,g,b
 	 * can never be greater than alpha.
@@ -343,21 +541,42 @@ int main(int argc, char **argv)
 		colors[i].b *= colors[i].a;
 	}
 
-	while (XNextEvent(dpy, &ev) == 0) {
-		if (ev.type == Expose && !ev.xexpose.count) {
-			if (do_tests(dpy, &window))
-				ret = 0;
-			else
-				ret = 1;
-			break;
-		}
+	if (xvfb_servers > 0)
+		display = start_xvfb(xvfb_servers);
+	if (num_jobs == 0)
+		num_jobs = count_displays(display);
+	/* A trace is of a single connection. */
+	if (record_path != NULL || replay_path != NULL)
+		num_jobs = 1;
+	results_init();
+
+	if (replay_path != NULL) {
+		if (display != NULL && strchr(display, ',') != NULL)
+			*strchr(display, ',') = '\0';
+		ret = replay_trace(display);
+	} else if (num_jobs > 1) {
+		ret = run_shards(run_tests, display);
+	} else {
+		/* A single job only uses the first display. */
+		if (display != NULL && strchr(display, ',') != NULL)
+			*strchr(display, ',') = '\0';
+		ret = run_tests(display);
+	}
+
+	/* Regressions get an exit status of their own, so that they can be
+	 * told apart from test failures.
+	 */
+	if (!results_compare())
+		ret = 2;
+
+	if (xvfb_servers > 0) {
+		stop_xvfb();
+		free(display);
 	}
 
-	free(window.name);
 	for (i = 0; i < format_whitelist_len; i++)
 		free(format_whitelist[i]);
 	free(format_whitelist);
 
-        XCloseDisplay(dpy);
 	return ret;
 }
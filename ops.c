@@ -20,7 +20,10 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "rendercheck.h"
 
@@ -245,3 +248,399 @@ do_composite(int op,
 	result->b = calc_op(op, srcval.b, dst->b, srcalpha.b, dst->a);
 	result->a = calc_op(op, srcval.a, dst->a, srcalpha.a, dst->a);
 }
+
+/* The Fa and Fb blend factors used by calc_op(), named from the point of view
+ * of the operand they scale: "a" is that operand's alpha and "b" the other
+ * operand's alpha.
+ */
+enum blend_factor {
+	FACTOR_INVALID,
+	FACTOR_ZERO,
+	FACTOR_ONE,
+	FACTOR_B,		/* b */
+	FACTOR_INV_B,		/* 1 - b */
+	FACTOR_DISJOINT_OUT,	/* min(1, (1 - b) / a), 1 if a == 0 */
+	FACTOR_DISJOINT_IN,	/* max(0, 1 - (1 - b) / a), 0 if a == 0 */
+	FACTOR_CONJOINT_IN,	/* min(1, b / a), 1 if a == 0 */
+	FACTOR_CONJOINT_OUT,	/* max(0, 1 - b / a), 0 if a == 0 */
+};
+
+static const struct {
+	enum blend_factor fa, fb;
+} op_factors[] = {
+	[PictOpClear] =			{ FACTOR_ZERO, FACTOR_ZERO },
+	[PictOpSrc] =			{ FACTOR_ONE, FACTOR_ZERO },
+	[PictOpDst] =			{ FACTOR_ZERO, FACTOR_ONE },
+	[PictOpOver] =			{ FACTOR_ONE, FACTOR_INV_B },
+	[PictOpOverReverse] =		{ FACTOR_INV_B, FACTOR_ONE },
+	[PictOpIn] =			{ FACTOR_B, FACTOR_ZERO },
+	[PictOpInReverse] =		{ FACTOR_ZERO, FACTOR_B },
+	[PictOpOut] =			{ FACTOR_INV_B, FACTOR_ZERO },
+	[PictOpOutReverse] =		{ FACTOR_ZERO, FACTOR_INV_B },
+	[PictOpAtop] =			{ FACTOR_B, FACTOR_INV_B },
+	[PictOpAtopReverse] =		{ FACTOR_INV_B, FACTOR_B },
+	[PictOpXor] =			{ FACTOR_INV_B, FACTOR_INV_B },
+	[PictOpAdd] =			{ FACTOR_ONE, FACTOR_ONE },
+	[PictOpSaturate] =		{ FACTOR_DISJOINT_OUT, FACTOR_ONE },
+
+	[PictOpDisjointClear] =		{ FACTOR_ZERO, FACTOR_ZERO },
+	[PictOpDisjointSrc] =		{ FACTOR_ONE, FACTOR_ZERO },
+	[PictOpDisjointDst] =		{ FACTOR_ZERO, FACTOR_ONE },
+	[PictOpDisjointOver] =		{ FACTOR_ONE, FACTOR_DISJOINT_OUT },
+	[PictOpDisjointOverReverse] =	{ FACTOR_DISJOINT_OUT, FACTOR_ONE },
+	[PictOpDisjointIn] =		{ FACTOR_DISJOINT_IN, FACTOR_ZERO },
+	[PictOpDisjointInReverse] =	{ FACTOR_ZERO, FACTOR_DISJOINT_IN },
+	[PictOpDisjointOut] =		{ FACTOR_DISJOINT_OUT, FACTOR_ZERO },
+	[PictOpDisjointOutReverse] =	{ FACTOR_ZERO, FACTOR_DISJOINT_OUT },
+	[PictOpDisjointAtop] =		{ FACTOR_DISJOINT_IN, FACTOR_DISJOINT_OUT },
+	[PictOpDisjointAtopReverse] =	{ FACTOR_DISJOINT_OUT, FACTOR_DISJOINT_IN },
+	[PictOpDisjointXor] =		{ FACTOR_DISJOINT_OUT, FACTOR_DISJOINT_OUT },
+
+	[PictOpConjointClear] =		{ FACTOR_ZERO, FACTOR_ZERO },
+	[PictOpConjointSrc] =		{ FACTOR_ONE, FACTOR_ZERO },
+	[PictOpConjointDst] =		{ FACTOR_ZERO, FACTOR_ONE },
+	[PictOpConjointOver] =		{ FACTOR_ONE, FACTOR_CONJOINT_OUT },
+	[PictOpConjointOverReverse] =	{ FACTOR_CONJOINT_OUT, FACTOR_ONE },
+	[PictOpConjointIn] =		{ FACTOR_CONJOINT_IN, FACTOR_ZERO },
+	[PictOpConjointInReverse] =	{ FACTOR_ZERO, FACTOR_CONJOINT_IN },
+	[PictOpConjointOut] =		{ FACTOR_CONJOINT_OUT, FACTOR_ZERO },
+	[PictOpConjointOutReverse] =	{ FACTOR_ZERO, FACTOR_CONJOINT_OUT },
+	[PictOpConjointAtop] =		{ FACTOR_CONJOINT_IN, FACTOR_CONJOINT_OUT },
+	[PictOpConjointAtopReverse] =	{ FACTOR_CONJOINT_OUT, FACTOR_CONJOINT_IN },
+	[PictOpConjointXor] =		{ FACTOR_CONJOINT_OUT, FACTOR_CONJOINT_OUT },
+};
+
+/* Number of pixels do_composite_batch() works on at a time. */
+#define BATCH_CHUNK 64
+
+/* Evaluates factor for n channels.  The switch is outside of the loops so
+ * that each one is a simple arithmetic loop over the arrays.
+ */
+static void
+calc_factor(enum blend_factor factor, const double *a, const double *b,
+	    double *f, int n)
+{
+	int i;
+
+	switch (factor) {
+	case FACTOR_ZERO:
+		for (i = 0; i < n; i++)
+			f[i] = 0.0;
+		break;
+	case FACTOR_ONE:
+		for (i = 0; i < n; i++)
+			f[i] = 1.0;
+		break;
+	case FACTOR_B:
+		for (i = 0; i < n; i++)
+			f[i] = b[i];
+		break;
+	case FACTOR_INV_B:
+		for (i = 0; i < n; i++)
+			f[i] = 1.0 - b[i];
+		break;
+	case FACTOR_DISJOINT_OUT:
+		for (i = 0; i < n; i++) {
+			if (a[i] == 0.0)
+				f[i] = 1.0;
+			else
+				f[i] = min(1.0, (1.0 - b[i]) / a[i]);
+		}
+		break;
+	case FACTOR_DISJOINT_IN:
+		for (i = 0; i < n; i++) {
+			if (a[i] == 0.0)
+				f[i] = 0.0;
+			else
+				f[i] = max(0.0, 1.0 - (1.0 - b[i]) / a[i]);
+		}
+		break;
+	case FACTOR_CONJOINT_IN:
+		for (i = 0; i < n; i++) {
+			if (a[i] == 0.0)
+				f[i] = 1.0;
+			else
+				f[i] = min(1.0, b[i] / a[i]);
+		}
+		break;
+	case FACTOR_CONJOINT_OUT:
+		for (i = 0; i < n; i++) {
+			if (a[i] == 0.0)
+				f[i] = 0.0;
+			else
+				f[i] = max(0.0, 1.0 - b[i] / a[i]);
+		}
+		break;
+	default:
+		abort();
+	}
+}
+
+/* Computes the same results as calling do_composite() on each of the n
+ * src/mask/dst triples, with mask optionally NULL.  The pixels are split into
+ * separate arrays of channel values and alphas so that the factor selection
+ * for op is done once per chunk instead of once per channel.
+ */
+void
+do_composite_batch(int op,
+		   const color4d *src,
+		   const color4d *mask,
+		   const color4d *dst,
+		   color4d *result,
+		   int n,
+		   bool componentAlpha)
+{
+	double sv[4 * BATCH_CHUNK], sa[4 * BATCH_CHUNK];
+	double dv[4 * BATCH_CHUNK], da[4 * BATCH_CHUNK];
+	double fa[4 * BATCH_CHUNK], fb[4 * BATCH_CHUNK];
+	enum blend_factor factor_a, factor_b;
+	int base, i, c, chunk;
+
+	if (op < 0 || (unsigned int)op >= ARRAY_SIZE(op_factors))
+		abort();
+	factor_a = op_factors[op].fa;
+	factor_b = op_factors[op].fb;
+
+	for (base = 0; base < n; base += chunk) {
+		chunk = min(n - base, BATCH_CHUNK);
+
+		for (i = 0; i < chunk; i++) {
+			const color4d *s = &src[base + i];
+			const color4d *d = &dst[base + i];
+			double *v = &sv[4 * i], *a = &sa[4 * i];
+
+			if (mask != NULL && componentAlpha) {
+				const color4d *m = &mask[base + i];
+
+				v[0] = s->r * m->r;
+				v[1] = s->g * m->g;
+				v[2] = s->b * m->b;
+				v[3] = s->a * m->a;
+				a[0] = s->a * m->r;
+				a[1] = s->a * m->g;
+				a[2] = s->a * m->b;
+				a[3] = s->a * m->a;
+			} else if (mask != NULL) {
+				const color4d *m = &mask[base + i];
+
+				v[0] = s->r * m->a;
+				v[1] = s->g * m->a;
+				v[2] = s->b * m->a;
+				v[3] = s->a * m->a;
+				a[0] = a[1] = a[2] = a[3] = s->a * m->a;
+			} else {
+				v[0] = s->r;
+				v[1] = s->g;
+				v[2] = s->b;
+				v[3] = s->a;
+				a[0] = a[1] = a[2] = a[3] = s->a;
+			}
+
+			dv[4 * i + 0] = d->r;
+			dv[4 * i + 1] = d->g;
+			dv[4 * i + 2] = d->b;
+			dv[4 * i + 3] = d->a;
+			for (c = 0; c < 4; c++)
+				da[4 * i + c] = d->a;
+		}
+
+		calc_factor(factor_a, sa, da, fa, 4 * chunk);
+		calc_factor(factor_b, da, sa, fb, 4 * chunk);
+
+		for (i = 0; i < 4 * chunk; i++)
+			sv[i] = mult_chan(sv[i], dv[i], fa[i], fb[i]);
+
+		for (i = 0; i < chunk; i++) {
+			color4d *r = &result[base + i];
+
+			r->r = sv[4 * i + 0];
+			r->g = sv[4 * i + 1];
+			r->b = sv[4 * i + 2];
+			r->a = sv[4 * i + 3];
+		}
+	}
+}
+
+/* Everything the expected result of a composite depends on.  Keys are
+ * compared and hashed bytewise, so they must be zeroed before filling in to
+ * clear any padding.
+ */
+struct expected_key {
+	color4d src, mask, dst;
+	const XRenderPictFormat *format;
+	int op;
+	bool has_mask;
+	bool componentAlpha;
+};
+
+struct expected_entry {
+	struct expected_key key;
+	color4d result;
+	bool used;
+};
+
+static struct {
+	struct expected_entry *entries;
+	unsigned int size;	/* always a power of two */
+	unsigned int count;
+	unsigned long hits, misses;
+} expected_cache;
+
+static uint32_t
+hash_key(const struct expected_key *key)
+{
+	const uint8_t *p = (const uint8_t *)key;
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	/* FNV-1a */
+	for (i = 0; i < sizeof(*key); i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static struct expected_entry *
+lookup_entry(const struct expected_key *key)
+{
+	unsigned int i = hash_key(key) & (expected_cache.size - 1);
+
+	while (expected_cache.entries[i].used &&
+	       memcmp(&expected_cache.entries[i].key, key, sizeof(*key)) != 0)
+		i = (i + 1) & (expected_cache.size - 1);
+
+	return &expected_cache.entries[i];
+}
+
+static void
+grow_expected_cache(void)
+{
+	struct expected_entry *old = expected_cache.entries;
+	unsigned int old_size = expected_cache.size, i;
+
+	expected_cache.size = old_size ? old_size * 2 : 1024;
+	expected_cache.entries = calloc(expected_cache.size,
+					sizeof(*expected_cache.entries));
+	if (expected_cache.entries == NULL)
+		errx(1, "malloc error");
+
+	for (i = 0; i < old_size; i++) {
+		if (old[i].used)
+			*lookup_entry(&old[i].key) = old[i];
+	}
+	free(old);
+}
+
+static void
+make_key(struct expected_key *key, int op, const color4d *src,
+	 const color4d *mask, const color4d *dst, bool componentAlpha,
+	 const picture_info *dst_pi)
+{
+	memset(key, 0, sizeof(*key));
+	key->src = *src;
+	if (mask != NULL)
+		key->mask = *mask;
+	key->dst = *dst;
+	key->format = dst_pi->format;
+	key->op = op;
+	key->has_mask = mask != NULL;
+	key->componentAlpha = componentAlpha;
+}
+
+/* Fills result with the color-corrected expected values for compositing each
+ * of the n src/mask/dst triples with op onto dst_pi, as do_composite_batch()
+ * followed by color_correct() would.  The blend and composite tests see the
+ * same few colors over and over, so results are remembered for the rest of
+ * the run, and only the ones not seen before are computed.
+ */
+void
+get_expected_batch(int op,
+		   const color4d *src,
+		   const color4d *mask,
+		   const color4d *dst,
+		   color4d *result,
+		   int n,
+		   bool componentAlpha,
+		   picture_info *dst_pi)
+{
+	struct expected_key key;
+	color4d *msrc, *mmask, *mdst, *mresult;
+	int *missed;
+	int i, nmissed = 0;
+
+	if (n == 0)
+		return;
+	if (expected_cache.size == 0)
+		grow_expected_cache();
+
+	missed = malloc(sizeof(int) * n);
+	msrc = calloc(n, sizeof(color4d));
+	mmask = calloc(n, sizeof(color4d));
+	mdst = calloc(n, sizeof(color4d));
+	mresult = malloc(sizeof(color4d) * n);
+	if (missed == NULL || msrc == NULL || mmask == NULL || mdst == NULL ||
+	    mresult == NULL)
+		errx(1, "malloc error");
+
+	for (i = 0; i < n; i++) {
+		struct expected_entry *entry;
+
+		make_key(&key, op, &src[i], mask ? &mask[i] : NULL, &dst[i],
+			 componentAlpha, dst_pi);
+		entry = lookup_entry(&key);
+		if (entry->used) {
+			result[i] = entry->result;
+			expected_cache.hits++;
+			continue;
+		}
+
+		msrc[nmissed] = src[i];
+		if (mask != NULL)
+			mmask[nmissed] = mask[i];
+		mdst[nmissed] = dst[i];
+		missed[nmissed++] = i;
+	}
+	expected_cache.misses += nmissed;
+
+	do_composite_batch(op, msrc, mask ? mmask : NULL, mdst, mresult,
+			   nmissed, componentAlpha);
+
+	for (i = 0; i < nmissed; i++) {
+		struct expected_entry *entry;
+
+		color_correct(dst_pi, &mresult[i]);
+		result[missed[i]] = mresult[i];
+
+		make_key(&key, op, &msrc[i], mask ? &mmask[i] : NULL, &mdst[i],
+			 componentAlpha, dst_pi);
+		entry = lookup_entry(&key);
+		if (entry->used)
+			continue;
+
+		entry->key = key;
+		entry->result = mresult[i];
+		entry->used = true;
+		if (++expected_cache.count * 2 > expected_cache.size)
+			grow_expected_cache();
+	}
+
+	free(missed);
+	free(msrc);
+	free(mmask);
+	free(mdst);
+	free(mresult);
+}
+
+void
+free_expected_cache(void)
+{
+	if (is_verbose && expected_cache.size != 0) {
+		printf("Expected value cache: %u entries, %lu hits, "
+		       "%lu misses\n", expected_cache.count,
+		       expected_cache.hits, expected_cache.misses);
+	}
+
+	free(expected_cache.entries);
+	memset(&expected_cache, 0, sizeof(expected_cache));
+}
@@ -0,0 +1,376 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#if HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#include "rendercheck.h"
+
+/* With --perf, hardware performance counters of rendercheck and, if
+ * --server-pid gives one and we are allowed to, of the X server are read
+ * around each test group and benchmark, like the CPU times of cpu.c.  Only
+ * user space is counted, which is all an unprivileged user may count.
+ */
+
+bool perf_mode = false;
+
+#if HAVE_LINUX_PERF_EVENT_H
+
+static const struct {
+	uint64_t config;
+	const char *name;
+} events[] = {
+	{ PERF_COUNT_HW_CPU_CYCLES,		"cycles" },
+	{ PERF_COUNT_HW_INSTRUCTIONS,		"instructions" },
+	{ PERF_COUNT_HW_CACHE_MISSES,		"cache-misses" },
+	{ PERF_COUNT_HW_BRANCH_MISSES,		"branch-misses" },
+};
+
+#define NUM_EVENTS	ARRAY_SIZE(events)
+
+enum { PERF_CLIENT, PERF_SERVER, NUM_PROCESSES };
+
+static const char *process_names[NUM_PROCESSES] = { "client", "server" };
+
+struct perf_counts {
+	double count[NUM_PROCESSES][NUM_EVENTS];
+};
+
+struct perf_group {
+	const char *name;
+	struct perf_counts total;
+};
+
+static int fds[NUM_PROCESSES][NUM_EVENTS];
+static bool counting[NUM_PROCESSES];
+static struct perf_group *groups;
+static int num_groups;
+static struct perf_group *current;
+static struct perf_counts group_start, tuple_start;
+
+static int
+open_counter(pid_t pid, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+	    PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return syscall(SYS_perf_event_open, &attr, pid, -1, -1, 0);
+}
+
+/* Opens the counters of process p, returning false if any can't be. */
+static bool
+open_counters(int p, pid_t pid)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_EVENTS; i++) {
+		fds[p][i] = open_counter(pid, events[i].config);
+		if (fds[p][i] < 0) {
+			printf("Can't count %s %s: %s\n", process_names[p],
+			       events[i].name, strerror(errno));
+			while (i-- > 0)
+				close(fds[p][i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Reads the counters, scaled up for the time they weren't scheduled when the
+ * hardware has fewer counters than were asked for.
+ */
+static void
+sample(struct perf_counts *c)
+{
+	unsigned int i;
+	int p;
+
+	memset(c, 0, sizeof(*c));
+	for (p = 0; p < NUM_PROCESSES; p++) {
+		for (i = 0; counting[p] && i < NUM_EVENTS; i++) {
+			uint64_t v[3];
+
+			if (read(fds[p][i], v, sizeof(v)) != sizeof(v) ||
+			    v[2] == 0)
+				continue;
+			c->count[p][i] = (double)v[0] * v[1] / v[2];
+		}
+	}
+}
+
+static void
+subtract(struct perf_counts *a, const struct perf_counts *b)
+{
+	unsigned int i;
+	int p;
+
+	for (p = 0; p < NUM_PROCESSES; p++) {
+		for (i = 0; i < NUM_EVENTS; i++)
+			a->count[p][i] -= b->count[p][i];
+	}
+}
+
+void
+perf_init(void)
+{
+	if (!perf_mode)
+		return;
+
+	counting[PERF_CLIENT] = open_counters(PERF_CLIENT, 0);
+	if (server_pid > 0)
+		counting[PERF_SERVER] = open_counters(PERF_SERVER, server_pid);
+	if (!counting[PERF_CLIENT] && !counting[PERF_SERVER]) {
+		printf("Performance counters unavailable, disabling --perf\n");
+		perf_mode = false;
+	}
+}
+
+static struct perf_group *
+find_group(const char *name)
+{
+	struct perf_group *group;
+	int g;
+
+	for (g = 0; g < num_groups; g++) {
+		if (strcmp(groups[g].name, name) == 0)
+			return &groups[g];
+	}
+
+	groups = realloc(groups, sizeof(*groups) * (num_groups + 1));
+	if (groups == NULL)
+		errx(1, "realloc error");
+	group = &groups[num_groups++];
+	memset(group, 0, sizeof(*group));
+	group->name = name;
+	return group;
+}
+
+/* Charges the counts since the last call to the previous group, and starts
+ * charging the named one.
+ */
+void
+perf_group(const char *name)
+{
+	struct perf_counts now;
+	unsigned int i;
+	int p;
+
+	if (!perf_mode)
+		return;
+
+	sample(&now);
+	if (current != NULL) {
+		for (p = 0; p < NUM_PROCESSES; p++) {
+			for (i = 0; i < NUM_EVENTS; i++) {
+				current->total.count[p][i] +=
+				    now.count[p][i] - group_start.count[p][i];
+			}
+		}
+	}
+	group_start = now;
+	current = NULL;
+	if (name != NULL)
+		current = find_group(name);
+}
+
+static void
+print_counts(const char *name, const struct perf_counts *c)
+{
+	int p;
+
+	for (p = 0; p < NUM_PROCESSES; p++) {
+		const double *count = c->count[p];
+
+		if (!counting[p])
+			continue;
+		printf("%-20s %-6s %12.4g %12.4g %5.2f %12.4g %12.4g\n", name,
+		       process_names[p], count[0], count[1],
+		       count[0] ? count[1] / count[0] : 0, count[2], count[3]);
+	}
+}
+
+static void
+print_heading(const char *name)
+{
+	printf("%-27s       cycles instructions   IPC cache-misses "
+	       "branch-misses\n", name);
+}
+
+void
+perf_tuple_begin(void)
+{
+	if (perf_mode)
+		sample(&tuple_start);
+}
+
+/* Prints the counts since perf_tuple_begin(). */
+void
+perf_tuple_end(void)
+{
+	struct perf_counts now;
+
+	if (!perf_mode)
+		return;
+
+	sample(&now);
+	subtract(&now, &tuple_start);
+	print_counts("", &now);
+}
+
+/* Hands the group counts of a --jobs child to the parent, which adds up those
+ * of all the children with perf_receive() before printing them.  Which
+ * processes were counted goes first, since a child may have found its
+ * counters unavailable.
+ */
+void
+perf_send(void)
+{
+	int g;
+
+	if (current != NULL)
+		perf_group(NULL);
+
+	shard_write(counting, sizeof(counting));
+	shard_write(&num_groups, sizeof(num_groups));
+	for (g = 0; g < num_groups; g++) {
+		shard_write_string(groups[g].name);
+		shard_write(&groups[g].total, sizeof(groups[g].total));
+	}
+}
+
+bool
+perf_receive(int fd)
+{
+	bool received_counting[NUM_PROCESSES];
+	unsigned int i;
+	int g, n, p;
+
+	if (!shard_read(fd, received_counting, sizeof(received_counting)) ||
+	    !shard_read(fd, &n, sizeof(n)))
+		return false;
+	for (p = 0; p < NUM_PROCESSES; p++)
+		counting[p] |= received_counting[p];
+
+	for (g = 0; g < n; g++) {
+		struct perf_counts received;
+		struct perf_group *group;
+		char *name = shard_read_string(fd);
+
+		if (name == NULL)
+			return false;
+		if (!shard_read(fd, &received, sizeof(received))) {
+			free(name);
+			return false;
+		}
+
+		group = find_group(name);
+		if (group->name != name)
+			free(name);
+		for (p = 0; p < NUM_PROCESSES; p++) {
+			for (i = 0; i < NUM_EVENTS; i++) {
+				group->total.count[p][i] +=
+				    received.count[p][i];
+			}
+		}
+	}
+	return true;
+}
+
+void
+perf_report(void)
+{
+	int g;
+
+	/* The parent of --jobs children only knows whether any counted. */
+	if (!perf_mode || (!counting[PERF_CLIENT] && !counting[PERF_SERVER]))
+		return;
+
+	if (current != NULL)
+		perf_group(NULL);
+	print_heading("Performance counters:");
+	for (g = 0; g < num_groups; g++)
+		print_counts(groups[g].name, &groups[g].total);
+
+	free(groups);
+	groups = NULL;
+	num_groups = 0;
+}
+
+#else /* !HAVE_LINUX_PERF_EVENT_H */
+
+void
+perf_init(void)
+{
+	if (perf_mode) {
+		printf("Performance counters not supported, disabling --perf\n");
+		perf_mode = false;
+	}
+}
+
+void
+perf_group(const char *name)
+{
+	(void)name;
+}
+
+void
+perf_tuple_begin(void)
+{
+}
+
+void
+perf_tuple_end(void)
+{
+}
+
+void
+perf_send(void)
+{
+}
+
+bool
+perf_receive(int fd)
+{
+	(void)fd;
+	return true;
+}
+
+void
+perf_report(void)
+{
+}
+
+#endif
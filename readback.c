@@ -0,0 +1,313 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib-xcb.h>
+#include "rendercheck.h"
+
+/* Number of readback images that may be outstanding at once before
+ * get_image() falls back to plain XGetImage().
+ */
+#define NUM_SEGMENTS 4
+
+struct readback_segment {
+	XShmSegmentInfo *shm_info;
+	XImage *image;
+	bool busy;
+};
+
+static struct readback_segment segments[NUM_SEGMENTS];
+static size_t segment_size;
+
+static bool had_x_error;
+static int (*orig_x_error_handler)(Display *, XErrorEvent *);
+
+static int
+shmerrorhandler(Display *d, XErrorEvent *e)
+{
+	had_x_error = true;
+	if (e->error_code == BadAccess) {
+		fprintf(stderr,"failed to attach shared memory\n");
+		return 0;
+	} else {
+		return (*orig_x_error_handler)(d,e);
+	}
+}
+
+/* Creates a SysV shared memory segment of the given size and attaches it to
+ * the server.  Returns NULL if MIT-SHM is missing or the server couldn't
+ * attach the segment, as happens with remote displays.
+ */
+XShmSegmentInfo *
+get_x_shm_info(Display *dpy, size_t size)
+{
+	XShmSegmentInfo *shm_info;
+
+	if (!XShmQueryExtension(dpy))
+		return NULL;
+
+	shm_info = calloc(1, sizeof(*shm_info));
+	if (shm_info == NULL)
+		return NULL;
+
+	shm_info->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT|0777);
+	if (shm_info->shmid < 0) {
+		free(shm_info);
+		return NULL;
+	}
+
+	shm_info->shmaddr = shmat(shm_info->shmid, NULL, 0);
+	if (shm_info->shmaddr == (void *)-1) {
+		shmctl(shm_info->shmid, IPC_RMID, NULL);
+		free(shm_info);
+		return NULL;
+	}
+
+	shm_info->readOnly = false;
+
+	XSync(dpy, true);
+	had_x_error = false;
+	orig_x_error_handler = XSetErrorHandler(shmerrorhandler);
+	XShmAttach(dpy, shm_info);
+	XSync(dpy, true);
+	XSetErrorHandler(orig_x_error_handler);
+
+	if (had_x_error) {
+		shmdt(shm_info->shmaddr);
+		shmctl(shm_info->shmid, IPC_RMID, NULL);
+		free(shm_info);
+		return NULL;
+	}
+
+	return shm_info;
+}
+
+void
+free_x_shm_info(Display *dpy, XShmSegmentInfo *shm_info)
+{
+	XShmDetach(dpy, shm_info);
+	/* Wait for server to fully detach before removing. */
+	XSync(dpy, False);
+	shmdt(shm_info->shmaddr);
+	shmctl(shm_info->shmid, IPC_RMID, NULL);
+	free(shm_info);
+}
+
+/* Sets up the pool of shared memory segments used by get_image(), each big
+ * enough for the largest canvas the tests read back.  If MIT-SHM isn't usable
+ * the pool stays empty and every readback goes through XGetImage().
+ */
+void
+init_readback(Display *dpy)
+{
+	int i;
+
+	segment_size = (size_t)max(win_width, 40) * max(win_height, 40) * 4;
+
+	for (i = 0; i < NUM_SEGMENTS; i++) {
+		segments[i].shm_info = get_x_shm_info(dpy, segment_size);
+		if (segments[i].shm_info == NULL)
+			break;
+	}
+
+	if (is_verbose) {
+		if (i == 0)
+			printf("MIT-SHM unavailable, reading back with "
+			       "XGetImage\n");
+		else
+			printf("Reading back through %d MIT-SHM segments\n", i);
+	}
+}
+
+void
+fini_readback(Display *dpy)
+{
+	int i;
+
+	for (i = 0; i < NUM_SEGMENTS; i++) {
+		if (segments[i].image)
+			XDestroyImage(segments[i].image);
+		if (segments[i].shm_info)
+			free_x_shm_info(dpy, segments[i].shm_info);
+	}
+	memset(segments, 0, sizeof(segments));
+}
+
+/* Returns the XImage describing a w x h readback of the given depth into a
+ * pool segment, reusing the one from the last readback of the same size.
+ */
+static XImage *
+get_segment_image(Display *dpy, struct readback_segment *seg, int depth,
+		  int w, int h)
+{
+	if (seg->image != NULL &&
+	    (seg->image->width != w || seg->image->height != h ||
+	     seg->image->depth != depth)) {
+		XDestroyImage(seg->image);
+		seg->image = NULL;
+	}
+	if (seg->image == NULL) {
+		seg->image = XShmCreateImage(dpy, NULL, depth, ZPixmap,
+					     seg->shm_info->shmaddr,
+					     seg->shm_info, w, h);
+		if (seg->image == NULL)
+			return NULL;
+	}
+	if ((size_t)seg->image->bytes_per_line * h > segment_size)
+		return NULL;
+
+	return seg->image;
+}
+
+/* Starts reading back the w x h region of pi's drawable at (x, y) without
+ * waiting for the reply, which is collected by finish_get_image().  Requests
+ * sent after this one don't affect the contents read back, so the caller can
+ * go on rendering the next set of tests before verifying this one.
+ *
+ * When a free segment of the pool is available the request is a ShmGetImage
+ * into it, so no pixel data is copied through the socket or allocated.
+ */
+void
+begin_get_image(Display *dpy, struct pending_image *pending,
+		const picture_info *pi, int x, int y, int w, int h)
+{
+	xcb_connection_t *c = XGetXCBConnection(dpy);
+	int i;
+
+	latency_sync(dpy);
+	trace_get_image(dpy, pi->d, x, y, w, h);
+
+	pending->pi = pi;
+	pending->x = x;
+	pending->y = y;
+	pending->w = w;
+	pending->h = h;
+	pending->segment = -1;
+
+	for (i = 0; i < NUM_SEGMENTS; i++) {
+		struct readback_segment *seg = &segments[i];
+
+		if (seg->shm_info == NULL || seg->busy)
+			continue;
+
+		if (get_segment_image(dpy, seg, pi->format->depth, w, h) ==
+		    NULL)
+			break;
+
+		pending->segment = i;
+		pending->shm_cookie = xcb_shm_get_image(c, pi->d, x, y, w, h,
+		    ~0, XCB_IMAGE_FORMAT_Z_PIXMAP, seg->shm_info->shmseg, 0);
+		seg->busy = true;
+		return;
+	}
+
+	pending->cookie = xcb_get_image(c, XCB_IMAGE_FORMAT_Z_PIXMAP, pi->d,
+	    x, y, w, h, ~0);
+}
+
+/* Waits for the reply to a begin_get_image() and returns the image, which must
+ * be handed back with release_image().
+ */
+XImage *
+finish_get_image(Display *dpy, struct pending_image *pending)
+{
+	xcb_connection_t *c = XGetXCBConnection(dpy);
+	const picture_info *pi = pending->pi;
+	xcb_generic_error_t *error = NULL;
+	xcb_get_image_reply_t *reply;
+	XImage *image;
+	char *data;
+	int length;
+
+	if (pending->segment >= 0) {
+		struct readback_segment *seg = &segments[pending->segment];
+		xcb_shm_get_image_reply_t *shm_reply;
+
+		shm_reply = xcb_shm_get_image_reply(c, pending->shm_cookie,
+						    &error);
+		if (shm_reply != NULL) {
+			free(shm_reply);
+			return seg->image;
+		}
+
+		/* The segment can't be read back into; fall back to a
+		 * synchronous transfer over the socket.
+		 */
+		free(error);
+		seg->busy = false;
+		return XGetImage(dpy, pi->d, pending->x, pending->y,
+				 pending->w, pending->h, AllPlanes, ZPixmap);
+	}
+
+	reply = xcb_get_image_reply(c, pending->cookie, &error);
+	if (reply == NULL) {
+		/* Let Xlib report the error the usual way. */
+		free(error);
+		return XGetImage(dpy, pi->d, pending->x, pending->y,
+				 pending->w, pending->h, AllPlanes, ZPixmap);
+	}
+
+	length = xcb_get_image_data_length(reply);
+	data = malloc(length);
+	if (data == NULL)
+		errx(1, "malloc error");
+	memcpy(data, xcb_get_image_data(reply), length);
+	free(reply);
+
+	image = XCreateImage(dpy, NULL, pi->format->depth, ZPixmap, 0, data,
+			     pending->w, pending->h, 32,
+			     length / pending->h);
+	if (image == NULL)
+		errx(1, "XCreateImage failed");
+
+	return image;
+}
+
+/* Reads back the w x h region of pi's drawable at (x, y).  The result must be
+ * handed back with release_image().
+ */
+XImage *
+get_image(Display *dpy, const picture_info *pi, int x, int y, int w, int h)
+{
+	struct pending_image pending;
+
+	begin_get_image(dpy, &pending, pi, x, y, w, h);
+	return finish_get_image(dpy, &pending);
+}
+
+void
+release_image(XImage *image)
+{
+	int i;
+
+	for (i = 0; i < NUM_SEGMENTS; i++) {
+		if (segments[i].image == image) {
+			segments[i].busy = false;
+			return;
+		}
+	}
+
+	XDestroyImage(image);
+}
@@ -22,6 +22,9 @@
 
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrender.h>
+#include <X11/extensions/XShm.h>
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -60,6 +63,19 @@ typedef struct _picture_info {
 	color4d color;		/* If a 1x1R pict, the (corrected) color.*/
 } picture_info;
 
+/* A readback started with begin_get_image() whose reply hasn't been collected
+ * yet.
+ */
+struct pending_image {
+	const picture_info *pi;
+	int x, y, w, h;
+	int segment;		/* MIT-SHM pool segment, or -1 if none. */
+	union {
+		xcb_get_image_cookie_t cookie;
+		xcb_shm_get_image_cookie_t shm_cookie;
+	};
+};
+
 struct op_info {
 	int op;
 	const char *name;
@@ -95,6 +111,18 @@ record_result(struct rendercheck_test_result *result, bool success)
 #define TEST_gtk_argb_xbgr	0x2000
 #define TEST_libreoffice_xrgb	0x4000
 #define TEST_shmblend		0x8000
+#define TEST_glyphs		0x10000
+
+#define BENCH_COMPOSITE		0x0001
+#define BENCH_SIZES		0x0002
+#define BENCH_TRIANGLES		0x0004
+#define BENCH_GRADIENTS		0x0008
+#define BENCH_shmupload		0x0010
+#define BENCH_glyphs		0x0020
+#define BENCH_REPEAT		0x0040
+#define BENCH_transforms	0x0080
+#define BENCH_WARMUP		0x0100
+#define BENCH_SCENES		0x0200
 
 struct rendercheck_test {
 	int bit;
@@ -115,6 +143,39 @@ struct rendercheck_test {
 		.func = func_,						\
 	}
 
+/* Benchmarks that set up their own pictures register like tests do. */
+struct rendercheck_bench {
+	int bit;
+	const char *arg_name;
+	const char *long_name;
+	void (*func)(Display *dpy);
+};
+
+#define DECLARE_RENDERCHECK_BENCH(name)		  \
+	const struct rendercheck_bench bench_desc_##name \
+	__attribute__ ((section ("bench_section")))
+
+#define DECLARE_RENDERCHECK_ARG_BENCH(arg_name_, long_name_, func_)		\
+	DECLARE_RENDERCHECK_BENCH(arg_name_) = {				\
+		.bit = BENCH_##arg_name_,				\
+		.arg_name = #arg_name_,					\
+		.long_name = long_name_,				\
+		.func = func_,						\
+	}
+
+/* One benchmark for run_benchmark().  Each iteration does units of work,
+ * counted in unit_name, touching pixels destination pixels.
+ */
+struct bench_desc {
+	const char *name;
+	void (*func)(Display *dpy, void *data, int iterations);
+	void *data;
+	int iterations;
+	double units;
+	const char *unit_name;
+	double pixels;
+};
+
 struct render_format {
 	XRenderPictFormat *format;
 	char *name;
@@ -128,6 +189,7 @@ extern int nformats;
  * in their sections.
  */
 extern struct rendercheck_test __start_test_section, __stop_test_section;
+extern struct rendercheck_bench __start_bench_section, __stop_bench_section;
 
 extern int pixmap_move_iter;
 extern int win_width, win_height;
@@ -167,6 +229,12 @@ get_pixel_from_image(XImage *image,
 		     int x, int y,
 		     color4d *color);
 
+void
+get_pixels_from_image(XImage *image,
+		      const picture_info *pi,
+		      int x, int y, int w, int h,
+		      color4d *colors);
+
 void
 accuracy(XRenderDirectFormat *result,
 	 const XRenderDirectFormat *a,
@@ -208,6 +276,228 @@ do_composite(int op,
 	     color4d *result,
 	     bool componentAlpha);
 
+void
+do_composite_batch(int op,
+		   const color4d *src,
+		   const color4d *mask,
+		   const color4d *dst,
+		   color4d *result,
+		   int n,
+		   bool componentAlpha);
+
+void
+get_expected_batch(int op,
+		   const color4d *src,
+		   const color4d *mask,
+		   const color4d *dst,
+		   color4d *result,
+		   int n,
+		   bool componentAlpha,
+		   picture_info *dst_pi);
+
+void
+free_expected_cache(void);
+
+/* bench.c */
+extern int enabled_benchmarks;
+extern int bench_iterations;
+extern int bench_warmup_trials;
+extern int bench_trials;
+extern double bench_min_time;
+extern double bench_precision;
+
+double
+get_time(void);
+
+double
+run_benchmark(Display *dpy, const struct bench_desc *desc);
+
+double
+run_warmup(Display *dpy, const struct bench_desc *desc, int iterations);
+
+/* cpu.c */
+extern pid_t server_pid;
+
+void
+cpu_init(const char *display);
+
+void
+cpu_group(const char *name);
+
+void
+cpu_tuple_begin(void);
+
+void
+cpu_tuple_end(void);
+
+void
+cpu_send(void);
+
+bool
+cpu_receive(int fd);
+
+void
+cpu_report(void);
+
+/* latency.c */
+extern bool latency_mode;
+
+void
+latency_init(Display *dpy);
+
+void
+latency_group(const char *name);
+
+void
+latency_record(double seconds);
+
+void
+latency_sync(Display *dpy);
+
+void
+latency_send(void);
+
+bool
+latency_receive(int fd);
+
+void
+latency_report(void);
+
+/* results.c */
+extern char *results_path;
+extern char *compare_path;
+extern double compare_threshold;
+
+void
+results_init(void);
+
+void
+results_header(Display *dpy);
+
+void
+results_record(const char *name, double value, const char *unit_name);
+
+bool
+results_compare(void);
+
+/* trace.c */
+extern char *record_path;
+extern char *replay_path;
+extern bool replay_paced;
+
+void
+trace_init(Display *dpy);
+
+void
+trace_fini(Display *dpy);
+
+void
+trace_get_image(Display *dpy, Drawable d, int x, int y, int w, int h);
+
+void
+trace_get_input_focus(Display *dpy);
+
+int
+replay_trace(const char *display);
+
+/* scene.c */
+extern char *scene_paths;
+
+void
+scene_bench(Display *dpy, const char *path);
+
+/* shard.c */
+extern int num_jobs;
+
+bool
+shard_begin(void);
+
+void
+shard_report(int tests_passed, int tests_total, int success_mask);
+
+void
+shard_write(const void *data, size_t size);
+
+void
+shard_write_string(const char *s);
+
+bool
+shard_read(int fd, void *data, size_t size);
+
+char *
+shard_read_string(int fd);
+
+bool
+shard_first(void);
+
+void
+shard_window_position(Display *dpy, int *x, int *y);
+
+pid_t
+xvfb_pid(const char *display);
+
+int
+count_displays(const char *display);
+
+char *
+start_xvfb(int n);
+
+void
+stop_xvfb(void);
+
+int
+run_shards(int (*run)(const char *display), const char *display);
+
+/* perf.c */
+extern bool perf_mode;
+
+void
+perf_init(void);
+
+void
+perf_group(const char *name);
+
+void
+perf_tuple_begin(void);
+
+void
+perf_tuple_end(void);
+
+void
+perf_send(void);
+
+bool
+perf_receive(int fd);
+
+void
+perf_report(void);
+
+/* readback.c */
+XShmSegmentInfo *
+get_x_shm_info(Display *dpy, size_t size);
+
+void
+free_x_shm_info(Display *dpy, XShmSegmentInfo *shm_info);
+
+void
+init_readback(Display *dpy);
+
+void
+fini_readback(Display *dpy);
+
+void
+begin_get_image(Display *dpy, struct pending_image *pending,
+		const picture_info *pi, int x, int y, int w, int h);
+
+XImage *
+finish_get_image(Display *dpy, struct pending_image *pending);
+
+XImage *
+get_image(Display *dpy, const picture_info *pi, int x, int y, int w, int h);
+
+void
+release_image(XImage *image);
+
 /* The tests */
 bool
 blend_test(Display *dpy, picture_info *win, picture_info *dst,
@@ -223,12 +513,28 @@ composite_test(Display *dpy, picture_info *win, picture_info *dst,
 	       const picture_info **dst_color, int num_dst,
 	       bool componentAlpha);
 
+void
+composite_bench(Display *dpy, picture_info *dst,
+		const int *op, int num_op,
+		const picture_info **src, int num_src,
+		const picture_info **mask, int num_mask);
+
+void
+composite_size_bench(Display *dpy, XRenderPictFormat *dst_format,
+		     const int *op, int num_op,
+		     const picture_info **src, int num_src);
+
+void
+composite_warmup_bench(Display *dpy, XRenderPictFormat *dst_format,
+		       const int *op, int num_op);
+
 bool
 dstcoords_test(Display *dpy, picture_info *win, int op, picture_info *dst,
     picture_info *bg, picture_info *fg);
 
 bool
-fill_test(Display *dpy, picture_info *win, picture_info *src);
+fill_test(Display *dpy, picture_info *win, picture_info *pictures, int size,
+    bool *ok);
 
 bool
 srccoords_test(Display *dpy, picture_info *win, picture_info *white,
@@ -247,11 +553,19 @@ bool render_to_gradient_test(Display *dpy, picture_info *src);
 bool linear_gradient_test(Display *dpy, picture_info *win,
                           picture_info *dst, int op, picture_info *dst_color);
 
+void
+gradient_bench(Display *dpy, XRenderPictFormat *dst_format,
+               const int *op, int num_op);
+
 bool
 repeat_test(Display *dpy, picture_info *win, picture_info *dst, int op,
     picture_info *dst_color, picture_info *c1, picture_info *c2,
     bool test_mask);
 
+void
+repeat_bench(Display *dpy, XRenderPictFormat *dst_format, const int *op,
+    int num_op, picture_info *c1, picture_info *c2);
+
 bool
 triangles_test(Display *dpy, picture_info *win, picture_info *dst, int op,
     picture_info *src_color, picture_info *dst_color);
@@ -264,6 +578,10 @@ bool
 trifan_test(Display *dpy, picture_info *win, picture_info *dst, int op,
     picture_info *src_color, picture_info *dst_color);
 
+void
+triangles_bench(Display *dpy, XRenderPictFormat *dst_format,
+		const int *op, int num_op, const picture_info *src);
+
 bool
 bug7366_test(Display *dpy);
 
@@ -271,3 +589,8 @@ bug7366_test(Display *dpy);
 	for (struct rendercheck_test *test = &__start_test_section;	\
 	     test < &__stop_test_section;				\
 	     test++)
+
+#define for_each_bench(bench)						\
+	for (struct rendercheck_bench *bench = &__start_bench_section;	\
+	     bench < &__stop_bench_section;				\
+	     bench++)
@@ -0,0 +1,266 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include "rendercheck.h"
+
+/* Benchmark results can be saved with --results, as a text file of one
+ * tab-separated record per line:
+ *
+ *	rendercheck-results	1
+ *	vendor	The X.Org Foundation
+ *	release	12101008
+ *	render	0.11
+ *	format	a8r8g8b8
+ *	result	Over a8r8g8b8 1x1 / none 40x40 -> a8r8g8b8	1234.5	composites
+ *
+ * The first line gives the version of the format.  Each result is the
+ * throughput of one benchmark, keyed by its name.  With --jobs, every job
+ * appends its own results, so they are in no particular order.
+ *
+ * With --compare, the results of this run are checked against those of an
+ * earlier file, and any that dropped by more than --threshold percent are
+ * reported as regressions.
+ */
+
+#define RESULTS_VERSION 1
+
+char *results_path;
+char *compare_path;
+double compare_threshold = 10;
+
+/* Opened before any jobs are forked, with O_APPEND, so that each record is
+ * written with a single write() and those of different jobs don't mix.
+ */
+static int results_fd = -1;
+
+struct result {
+	char *name;
+	double value;
+};
+
+static void
+results_printf(const char *fmt, ...) _X_ATTRIBUTE_PRINTF(1, 2);
+
+static void
+results_printf(const char *fmt, ...)
+{
+	char line[512];
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	if (len >= (int)sizeof(line))
+		len = sizeof(line) - 1;
+
+	if (write(results_fd, line, len) != len)
+		errx(1, "writing results: %s", strerror(errno));
+}
+
+/* Opens the file this run's results are written to: the --results file, or
+ * an anonymous temporary one when only comparing.
+ */
+void
+results_init(void)
+{
+	if (results_path == NULL && compare_path == NULL)
+		return;
+
+	if (results_path != NULL) {
+		results_fd = open(results_path,
+				  O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0666);
+		if (results_fd < 0)
+			errx(1, "%s: %s", results_path, strerror(errno));
+	} else {
+		char template[] = "/tmp/rendercheck-results-XXXXXX";
+
+		results_fd = mkstemp(template);
+		if (results_fd < 0)
+			errx(1, "mkstemp: %s", strerror(errno));
+		unlink(template);
+		fcntl(results_fd, F_SETFL, O_APPEND);
+	}
+
+	results_printf("rendercheck-results\t%d\n", RESULTS_VERSION);
+}
+
+/* Records the server and the formats being benchmarked.  Only the first job
+ * does so, since they all run against the same kind of server.
+ */
+void
+results_header(Display *dpy)
+{
+	int i, major, minor;
+
+	if (results_fd < 0 || !shard_first())
+		return;
+
+	XRenderQueryVersion(dpy, &major, &minor);
+	results_printf("vendor\t%s\n", XServerVendor(dpy));
+	results_printf("release\t%d\n", XVendorRelease(dpy));
+	results_printf("render\t%d.%d\n", major, minor);
+	for (i = 0; i < nformats; i++)
+		results_printf("format\t%s\n", formats[i].name);
+}
+
+void
+results_record(const char *name, double value, const char *unit_name)
+{
+	if (results_fd < 0)
+		return;
+
+	results_printf("result\t%s\t%.6g\t%s\n", name, value, unit_name);
+}
+
+static int
+compare_results(const void *a, const void *b)
+{
+	const struct result *ra = a, *rb = b;
+
+	return strcmp(ra->name, rb->name);
+}
+
+/* Reads the results of a file written by results_init() and friends, sorted
+ * by name.  The header lines are printed when verbose is set.
+ */
+static struct result *
+read_results(FILE *file, const char *path, int *num_results, bool verbose)
+{
+	struct result *results = NULL;
+	int allocated = 0, n = 0, version;
+	char line[1024];
+
+	if (fgets(line, sizeof(line), file) == NULL ||
+	    sscanf(line, "rendercheck-results\t%d", &version) != 1)
+		errx(1, "%s: not a rendercheck results file", path);
+	if (version != RESULTS_VERSION)
+		errx(1, "%s: unsupported results version %d", path, version);
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char *value, *name;
+
+		line[strcspn(line, "\n")] = '\0';
+		value = strchr(line, '\t');
+		if (value == NULL)
+			continue;
+		*value++ = '\0';
+
+		if (strcmp(line, "result") != 0) {
+			if (verbose && strcmp(line, "format") != 0)
+				printf("  %s %s\n", line, value);
+			continue;
+		}
+
+		name = value;
+		value = strchr(name, '\t');
+		if (value == NULL)
+			continue;
+		*value++ = '\0';
+
+		if (n == allocated) {
+			allocated = allocated ? allocated * 2 : 256;
+			results = realloc(results, sizeof(*results) * allocated);
+			if (results == NULL)
+				errx(1, "malloc error");
+		}
+		results[n].name = strdup(name);
+		results[n].value = strtod(value, NULL);
+		if (results[n].name == NULL)
+			errx(1, "malloc error");
+		n++;
+	}
+
+	qsort(results, n, sizeof(*results), compare_results);
+	*num_results = n;
+	return results;
+}
+
+static void
+free_results(struct result *results, int num_results)
+{
+	int i;
+
+	for (i = 0; i < num_results; i++)
+		free(results[i].name);
+	free(results);
+}
+
+/* Compares the results of this run against the --compare file, printing the
+ * benchmarks whose throughput dropped by more than compare_threshold percent.
+ * Returns false if there were any.
+ */
+bool
+results_compare(void)
+{
+	struct result *base, *cur;
+	int num_base, num_cur, i, regressions = 0, compared = 0;
+	FILE *file;
+
+	if (compare_path == NULL)
+		return true;
+
+	file = fopen(compare_path, "r");
+	if (file == NULL)
+		errx(1, "%s: %s", compare_path, strerror(errno));
+	printf("Comparing against %s:\n", compare_path);
+	base = read_results(file, compare_path, &num_base, true);
+	fclose(file);
+
+	lseek(results_fd, 0, SEEK_SET);
+	file = fdopen(dup(results_fd), "r");
+	if (file == NULL)
+		errx(1, "reading results: %s", strerror(errno));
+	cur = read_results(file, "results", &num_cur, false);
+	fclose(file);
+
+	for (i = 0; i < num_cur; i++) {
+		struct result *b = bsearch(&cur[i], base, num_base,
+					   sizeof(*base), compare_results);
+		double change;
+
+		if (b == NULL || b->value <= 0)
+			continue;
+
+		compared++;
+		change = (cur[i].value / b->value - 1) * 100;
+		if (change < -compare_threshold) {
+			printf("REGRESSION %-50s %12.2f -> %12.2f (%.1f%%)\n",
+			       cur[i].name, b->value, cur[i].value, change);
+			regressions++;
+		}
+	}
+
+	printf("%d of %d benchmarks regressed by more than %g%%\n",
+	       regressions, compared, compare_threshold);
+
+	free_results(base, num_base);
+	free_results(cur, num_cur);
+
+	return regressions == 0;
+}
@@ -0,0 +1,711 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "rendercheck.h"
+
+/* A scene file describes a frame of rendering, like an application would
+ * draw, to be benchmarked with --scene.  Each line is a command, with
+ * arguments separated by spaces, and # starts a comment.
+ *
+ * Pictures are declared first:
+ *
+ *	picture NAME FORMAT WxH [OPTIONS]
+ *	solid NAME R,G,B,A
+ *	linear NAME X1,Y1 X2,Y2 STOPS [OPTIONS]
+ *	radial NAME X,Y RADIUS STOPS [OPTIONS]
+ *
+ * where FORMAT is one of the format names rendercheck prints, such as
+ * a8r8g8b8, and colors are premultiplied, from 0 to 1.  The options are:
+ *
+ *	repeat none|normal|pad|reflect
+ *	filter NAME		any filter the server supports
+ *	scale S			magnifies the picture by S
+ *	rotate DEGREES		rotates the picture about its origin
+ *	fill R,G,B,A		initial contents of a picture
+ *	ca			component alpha
+ *
+ * Gradients take at least two "stop OFFSET R,G,B,A" before the options.
+ *
+ * Then the rendering, using the picture names and Render op names:
+ *
+ *	composite OP SRC MASK|none DST SX,SY [MX,MY] DX,DY WxH
+ *	fill OP DST R,G,B,A X,Y WxH
+ *	triangles OP SRC DST X1,Y1,X2,Y2,X3,Y3 ...
+ *	trapezoids OP SRC DST TOP,BOTTOM,LX1,LY1,LX2,LY2,RX1,RY1,RX2,RY2 ...
+ *	loop N [DX,DY]
+ *	...
+ *	end
+ *
+ * The mask origin MX,MY defaults to the source origin SX,SY.  Triangles and
+ * trapezoids go through an a8 mask.  Each iteration of a loop moves the
+ * destinations of the composites and fills in it by DX,DY further than the
+ * last, so that nested loops can lay out a grid.  The rendering is timed as
+ * one frame per iteration.
+ */
+
+/* Most stops of a gradient. */
+#define SCENE_MAX_STOPS	16
+
+struct scene_picture {
+	char *name;
+	Picture pict;
+	Pixmap pixmap;
+};
+
+enum scene_cmd_kind {
+	SCENE_COMPOSITE,
+	SCENE_FILL,
+	SCENE_TRIANGLES,
+	SCENE_TRAPEZOIDS,
+	SCENE_LOOP,
+};
+
+struct scene_cmd {
+	enum scene_cmd_kind kind;
+	int op;
+	Picture src, mask, dst;
+	int sx, sy, mx, my, dx, dy, w, h;
+	XRenderColor color;
+	XTriangle *triangles;
+	XTrapezoid *trapezoids;
+	int num;
+	/* For loops, the commands repeated num times, moved by dx,dy more each
+	 * time.
+	 */
+	struct scene_cmd *body;
+	int num_body;
+};
+
+struct scene {
+	const char *path;
+	int line;
+	Display *dpy;
+	XRenderPictFormat *mask_format;
+	struct scene_picture *pictures;
+	int num_pictures;
+	struct scene_cmd *cmds;
+	int num_cmds;
+};
+
+/* Comma-separated list of scene files given with --scene. */
+char *scene_paths;
+
+_X_NORETURN
+static void
+scene_error(const struct scene *s, const char *message, const char *arg)
+{
+	errx(1, "%s:%d: %s%s%s", s->path, s->line, message,
+	     arg ? ": " : "", arg ? arg : "");
+}
+
+/* Parses exactly n comma-separated numbers. */
+static void
+parse_numbers(const struct scene *s, const char *arg, double *v, int n)
+{
+	const char *p = arg;
+	char *end;
+	int i;
+
+	if (arg == NULL)
+		scene_error(s, "missing argument", NULL);
+
+	for (i = 0; i < n; i++) {
+		v[i] = strtod(p, &end);
+		if (end == p || *end != (i == n - 1 ? '\0' : ','))
+			scene_error(s, "bad numbers", arg);
+		p = end + 1;
+	}
+}
+
+static void
+parse_point(const struct scene *s, const char *arg, int *x, int *y)
+{
+	double v[2];
+
+	parse_numbers(s, arg, v, 2);
+	*x = v[0];
+	*y = v[1];
+}
+
+static void
+parse_size(const struct scene *s, const char *arg, int *w, int *h)
+{
+	char end;
+
+	if (arg == NULL || sscanf(arg, "%dx%d%c", w, h, &end) != 2 ||
+	    *w < 1 || *h < 1)
+		scene_error(s, "bad size", arg);
+}
+
+static void
+parse_color(const struct scene *s, const char *arg, XRenderColor *color)
+{
+	double v[4];
+
+	parse_numbers(s, arg, v, 4);
+	color->red = v[0] * 0xffff;
+	color->green = v[1] * 0xffff;
+	color->blue = v[2] * 0xffff;
+	color->alpha = v[3] * 0xffff;
+}
+
+static int
+parse_op(const struct scene *s, const char *arg)
+{
+	int i;
+
+	for (i = 0; arg != NULL && i < num_ops; i++) {
+		if (strcasecmp(ops[i].name, arg) == 0)
+			return ops[i].op;
+	}
+	scene_error(s, "unknown op", arg);
+}
+
+static Picture
+find_picture(const struct scene *s, const char *name, bool allow_none)
+{
+	int i;
+
+	if (name != NULL && allow_none && strcmp(name, "none") == 0)
+		return None;
+
+	for (i = 0; name != NULL && i < s->num_pictures; i++) {
+		if (strcmp(s->pictures[i].name, name) == 0)
+			return s->pictures[i].pict;
+	}
+	scene_error(s, "unknown picture", name);
+}
+
+/* Looks the format up among all those of the server, so that scenes don't
+ * depend on -f.
+ */
+static XRenderPictFormat *
+find_format(const struct scene *s, const char *name)
+{
+	XRenderPictFormat *format;
+	char *format_name;
+	bool found;
+	int i;
+
+	for (i = 0; name != NULL &&
+	     (format = XRenderFindFormat(s->dpy, 0, NULL, i)) != NULL; i++) {
+		describe_format(&format_name, NULL, format);
+		found = strcmp(format_name, name) == 0;
+		free(format_name);
+		if (found)
+			return format;
+	}
+	scene_error(s, "unknown format", name);
+}
+
+static struct scene_picture *
+add_picture(struct scene *s, const char *name)
+{
+	struct scene_picture *p;
+
+	if (name == NULL)
+		scene_error(s, "missing picture name", NULL);
+
+	s->pictures = realloc(s->pictures,
+	    sizeof(*s->pictures) * (s->num_pictures + 1));
+	if (s->pictures == NULL)
+		errx(1, "malloc error");
+	p = &s->pictures[s->num_pictures++];
+	p->name = strdup(name);
+	if (p->name == NULL)
+		errx(1, "malloc error");
+	p->pixmap = None;
+	p->pict = None;
+
+	return p;
+}
+
+/* Applies the options of a picture declaration, from *args on.  Only
+ * pictures with a pixmap are fillable.
+ */
+static void
+parse_picture_options(struct scene *s, Picture pict, char **args,
+		      bool fillable)
+{
+	static const char *repeat_names[] = {
+		[RepeatNone] = "none",
+		[RepeatNormal] = "normal",
+		[RepeatPad] = "pad",
+		[RepeatReflect] = "reflect",
+	};
+	XRenderPictureAttributes pa;
+	double scale = 1, angle = 0;
+	bool transform = false;
+	unsigned int i;
+
+	for (; *args != NULL; args++) {
+		const char *key = args[0], *arg = args[1];
+
+		if (strcmp(key, "ca") == 0) {
+			pa.component_alpha = true;
+			XRenderChangePicture(s->dpy, pict, CPComponentAlpha,
+					     &pa);
+			continue;
+		}
+
+		if (arg == NULL)
+			scene_error(s, "missing value", key);
+		args++;
+
+		if (strcmp(key, "repeat") == 0) {
+			for (i = 0; i < ARRAY_SIZE(repeat_names); i++) {
+				if (strcmp(repeat_names[i], arg) == 0)
+					break;
+			}
+			if (i == ARRAY_SIZE(repeat_names))
+				scene_error(s, "unknown repeat", arg);
+			pa.repeat = i;
+			XRenderChangePicture(s->dpy, pict, CPRepeat, &pa);
+		} else if (strcmp(key, "filter") == 0) {
+			XRenderSetPictureFilter(s->dpy, pict, arg, NULL, 0);
+		} else if (strcmp(key, "scale") == 0) {
+			parse_numbers(s, arg, &scale, 1);
+			if (scale <= 0)
+				scene_error(s, "bad scale", arg);
+			transform = true;
+		} else if (strcmp(key, "rotate") == 0) {
+			parse_numbers(s, arg, &angle, 1);
+			transform = true;
+		} else if (strcmp(key, "fill") == 0 && fillable) {
+			XRenderColor color;
+
+			parse_color(s, arg, &color);
+			XRenderFillRectangle(s->dpy, PictOpSrc, pict, &color,
+					     0, 0, 32767, 32767);
+		} else {
+			scene_error(s, "unknown option", key);
+		}
+	}
+
+	if (transform) {
+		double a = angle * M_PI / 180;
+		XTransform t;
+
+		/* The inverse of scaling then rotating, since the matrix
+		 * maps destination coordinates to source ones.
+		 */
+		memset(&t, 0, sizeof(t));
+		t.matrix[0][0] = XDoubleToFixed(cos(a) / scale);
+		t.matrix[0][1] = XDoubleToFixed(sin(a) / scale);
+		t.matrix[1][0] = XDoubleToFixed(-sin(a) / scale);
+		t.matrix[1][1] = XDoubleToFixed(cos(a) / scale);
+		t.matrix[2][2] = XDoubleToFixed(1);
+		XRenderSetPictureTransform(s->dpy, pict, &t);
+	}
+}
+
+/* Reads a gradient's stops, which must come before the other options since
+ * the picture can't be created without them.
+ */
+static int
+parse_stops(struct scene *s, char **args, XFixed *stops, XRenderColor *colors)
+{
+	int n = 0;
+
+	while (args[0] != NULL && strcmp(args[0], "stop") == 0) {
+		double offset;
+
+		if (n == SCENE_MAX_STOPS)
+			scene_error(s, "too many stops", NULL);
+		parse_numbers(s, args[1], &offset, 1);
+		stops[n] = XDoubleToFixed(offset);
+		if (args[2] == NULL)
+			scene_error(s, "missing stop color", NULL);
+		parse_color(s, args[2], &colors[n]);
+		n++;
+		args += 3;
+	}
+	if (n < 2)
+		scene_error(s, "gradients need at least two stops", NULL);
+
+	return n;
+}
+
+static void
+parse_picture(struct scene *s, char **args)
+{
+	struct scene_picture *p = add_picture(s, args[1]);
+	XFixed stops[SCENE_MAX_STOPS];
+	XRenderColor colors[SCENE_MAX_STOPS];
+	int num_stops;
+
+	if (strcmp(args[0], "picture") == 0) {
+		XRenderPictFormat *format = find_format(s, args[2]);
+		int w, h;
+
+		parse_size(s, args[3], &w, &h);
+		p->pixmap = XCreatePixmap(s->dpy, DefaultRootWindow(s->dpy),
+					  w, h, format->depth);
+		p->pict = XRenderCreatePicture(s->dpy, p->pixmap, format, 0,
+					       NULL);
+		parse_picture_options(s, p->pict, &args[4], true);
+	} else if (strcmp(args[0], "solid") == 0) {
+		XRenderColor color;
+
+		parse_color(s, args[2], &color);
+		p->pict = XRenderCreateSolidFill(s->dpy, &color);
+		parse_picture_options(s, p->pict, &args[3], false);
+	} else if (strcmp(args[0], "linear") == 0) {
+		XLinearGradient g;
+		int x1, y1, x2, y2;
+
+		parse_point(s, args[2], &x1, &y1);
+		parse_point(s, args[3], &x2, &y2);
+		g.p1.x = XDoubleToFixed(x1);
+		g.p1.y = XDoubleToFixed(y1);
+		g.p2.x = XDoubleToFixed(x2);
+		g.p2.y = XDoubleToFixed(y2);
+		num_stops = parse_stops(s, &args[4], stops, colors);
+		p->pict = XRenderCreateLinearGradient(s->dpy, &g, stops,
+						      colors, num_stops);
+		parse_picture_options(s, p->pict, &args[4 + 3 * num_stops],
+				      false);
+	} else {
+		XRadialGradient g;
+		double radius;
+		int x, y;
+
+		parse_point(s, args[2], &x, &y);
+		parse_numbers(s, args[3], &radius, 1);
+		g.inner.x = g.outer.x = XDoubleToFixed(x);
+		g.inner.y = g.outer.y = XDoubleToFixed(y);
+		g.inner.radius = 0;
+		g.outer.radius = XDoubleToFixed(radius);
+		num_stops = parse_stops(s, &args[4], stops, colors);
+		p->pict = XRenderCreateRadialGradient(s->dpy, &g, stops,
+						      colors, num_stops);
+		parse_picture_options(s, p->pict, &args[4 + 3 * num_stops],
+				      false);
+	}
+}
+
+static void
+parse_shapes(struct scene *s, struct scene_cmd *cmd, char **args)
+{
+	int i, n;
+
+	for (n = 0; args[n] != NULL; n++)
+		;
+	if (n == 0)
+		scene_error(s, "no shapes", NULL);
+	cmd->num = n;
+
+	if (cmd->kind == SCENE_TRIANGLES) {
+		cmd->triangles = malloc(sizeof(XTriangle) * n);
+		if (cmd->triangles == NULL)
+			errx(1, "malloc error");
+		for (i = 0; i < n; i++) {
+			XTriangle *t = &cmd->triangles[i];
+			double v[6];
+
+			parse_numbers(s, args[i], v, 6);
+			t->p1.x = XDoubleToFixed(v[0]);
+			t->p1.y = XDoubleToFixed(v[1]);
+			t->p2.x = XDoubleToFixed(v[2]);
+			t->p2.y = XDoubleToFixed(v[3]);
+			t->p3.x = XDoubleToFixed(v[4]);
+			t->p3.y = XDoubleToFixed(v[5]);
+		}
+	} else {
+		cmd->trapezoids = malloc(sizeof(XTrapezoid) * n);
+		if (cmd->trapezoids == NULL)
+			errx(1, "malloc error");
+		for (i = 0; i < n; i++) {
+			XTrapezoid *t = &cmd->trapezoids[i];
+			double v[10];
+
+			parse_numbers(s, args[i], v, 10);
+			t->top = XDoubleToFixed(v[0]);
+			t->bottom = XDoubleToFixed(v[1]);
+			t->left.p1.x = XDoubleToFixed(v[2]);
+			t->left.p1.y = XDoubleToFixed(v[3]);
+			t->left.p2.x = XDoubleToFixed(v[4]);
+			t->left.p2.y = XDoubleToFixed(v[5]);
+			t->right.p1.x = XDoubleToFixed(v[6]);
+			t->right.p1.y = XDoubleToFixed(v[7]);
+			t->right.p2.x = XDoubleToFixed(v[8]);
+			t->right.p2.y = XDoubleToFixed(v[9]);
+		}
+	}
+}
+
+/* Splits line into at most max_args words, ending the list with NULL. */
+static int
+split_line(char *line, char **args, int max_args)
+{
+	char *saveptr, *word;
+	int n = 0;
+
+	line[strcspn(line, "#\n")] = '\0';
+	for (word = strtok_r(line, " \t", &saveptr); word != NULL;
+	     word = strtok_r(NULL, " \t", &saveptr)) {
+		if (n == max_args - 1)
+			return -1;
+		args[n++] = word;
+	}
+	args[n] = NULL;
+
+	return n;
+}
+
+/* Parses commands up to the end of the file, or the "end" of a loop if
+ * in_loop.  The commands are stored in *cmds.
+ */
+static int
+parse_block(struct scene *s, FILE *file, struct scene_cmd **cmds, bool in_loop)
+{
+	char line[4096], *args[256];
+	int num_cmds = 0;
+
+	*cmds = NULL;
+	while (fgets(line, sizeof(line), file) != NULL) {
+		struct scene_cmd *cmd;
+		int n;
+
+		s->line++;
+		n = split_line(line, args, ARRAY_SIZE(args));
+		if (n < 0)
+			scene_error(s, "too many arguments", NULL);
+		if (n == 0)
+			continue;
+
+		if (strcmp(args[0], "end") == 0) {
+			if (!in_loop)
+				scene_error(s, "end outside a loop", NULL);
+			return num_cmds;
+		}
+
+		if (strcmp(args[0], "picture") == 0 ||
+		    strcmp(args[0], "solid") == 0 ||
+		    strcmp(args[0], "linear") == 0 ||
+		    strcmp(args[0], "radial") == 0) {
+			if (n < 3)
+				scene_error(s, "missing arguments", args[0]);
+			parse_picture(s, args);
+			continue;
+		}
+
+		*cmds = realloc(*cmds, sizeof(**cmds) * (num_cmds + 1));
+		if (*cmds == NULL)
+			errx(1, "malloc error");
+		cmd = &(*cmds)[num_cmds++];
+		memset(cmd, 0, sizeof(*cmd));
+
+		if (strcmp(args[0], "composite") == 0) {
+			if (n != 8 && n != 9)
+				scene_error(s, "composite takes 7 or 8 "
+					    "arguments", NULL);
+			cmd->kind = SCENE_COMPOSITE;
+			cmd->op = parse_op(s, args[1]);
+			cmd->src = find_picture(s, args[2], false);
+			cmd->mask = find_picture(s, args[3], true);
+			cmd->dst = find_picture(s, args[4], false);
+			parse_point(s, args[5], &cmd->sx, &cmd->sy);
+			cmd->mx = cmd->sx;
+			cmd->my = cmd->sy;
+			if (n == 9)
+				parse_point(s, args[6], &cmd->mx, &cmd->my);
+			parse_point(s, args[n - 2], &cmd->dx, &cmd->dy);
+			parse_size(s, args[n - 1], &cmd->w, &cmd->h);
+		} else if (strcmp(args[0], "fill") == 0) {
+			if (n != 6)
+				scene_error(s, "fill takes 5 arguments", NULL);
+			cmd->kind = SCENE_FILL;
+			cmd->op = parse_op(s, args[1]);
+			cmd->dst = find_picture(s, args[2], false);
+			parse_color(s, args[3], &cmd->color);
+			parse_point(s, args[4], &cmd->dx, &cmd->dy);
+			parse_size(s, args[5], &cmd->w, &cmd->h);
+		} else if (strcmp(args[0], "triangles") == 0 ||
+			   strcmp(args[0], "trapezoids") == 0) {
+			if (strcmp(args[0], "triangles") == 0)
+				cmd->kind = SCENE_TRIANGLES;
+			else
+				cmd->kind = SCENE_TRAPEZOIDS;
+			cmd->op = parse_op(s, args[1]);
+			cmd->src = find_picture(s, args[2], false);
+			cmd->dst = find_picture(s, args[3], false);
+			parse_shapes(s, cmd, &args[4]);
+		} else if (strcmp(args[0], "loop") == 0) {
+			double count;
+
+			if (n > 3)
+				scene_error(s, "loop takes 1 or 2 arguments",
+					    NULL);
+			parse_numbers(s, args[1], &count, 1);
+			if (count < 1)
+				scene_error(s, "bad loop count", args[1]);
+			cmd->kind = SCENE_LOOP;
+			cmd->num = count;
+			if (n == 3)
+				parse_point(s, args[2], &cmd->dx, &cmd->dy);
+			cmd->num_body = parse_block(s, file, &cmd->body, true);
+			/* The realloc()s of the body may have moved us. */
+			cmd = &(*cmds)[num_cmds - 1];
+		} else {
+			scene_error(s, "unknown command", args[0]);
+		}
+	}
+
+	if (in_loop)
+		scene_error(s, "loop without end", NULL);
+
+	return num_cmds;
+}
+
+/* Runs the commands with their destinations moved by x,y. */
+static void
+run_cmds(struct scene *s, const struct scene_cmd *cmds, int num_cmds,
+	 int x, int y)
+{
+	int i, j;
+
+	for (i = 0; i < num_cmds; i++) {
+		const struct scene_cmd *cmd = &cmds[i];
+
+		switch (cmd->kind) {
+		case SCENE_COMPOSITE:
+			XRenderComposite(s->dpy, cmd->op, cmd->src, cmd->mask,
+					 cmd->dst, cmd->sx, cmd->sy,
+					 cmd->mx, cmd->my, x + cmd->dx,
+					 y + cmd->dy, cmd->w, cmd->h);
+			break;
+		case SCENE_FILL:
+			XRenderFillRectangle(s->dpy, cmd->op, cmd->dst,
+					     &cmd->color, x + cmd->dx,
+					     y + cmd->dy, cmd->w, cmd->h);
+			break;
+		case SCENE_TRIANGLES:
+			XRenderCompositeTriangles(s->dpy, cmd->op, cmd->src,
+						  cmd->dst, s->mask_format,
+						  0, 0, cmd->triangles,
+						  cmd->num);
+			break;
+		case SCENE_TRAPEZOIDS:
+			XRenderCompositeTrapezoids(s->dpy, cmd->op, cmd->src,
+						   cmd->dst, s->mask_format,
+						   0, 0, cmd->trapezoids,
+						   cmd->num);
+			break;
+		case SCENE_LOOP:
+			for (j = 0; j < cmd->num; j++) {
+				run_cmds(s, cmd->body, cmd->num_body,
+					 x + j * cmd->dx, y + j * cmd->dy);
+			}
+			break;
+		}
+	}
+}
+
+/* Returns the destination pixels the commands cover, for reporting
+ * Mpixels/s.  Triangles and trapezoids aren't counted.
+ */
+static double
+count_pixels(const struct scene_cmd *cmds, int num_cmds)
+{
+	double pixels = 0;
+	int i;
+
+	for (i = 0; i < num_cmds; i++) {
+		if (cmds[i].kind == SCENE_LOOP) {
+			pixels += cmds[i].num *
+			    count_pixels(cmds[i].body, cmds[i].num_body);
+		} else {
+			pixels += (double)cmds[i].w * cmds[i].h;
+		}
+	}
+
+	return pixels;
+}
+
+static void
+free_cmds(struct scene_cmd *cmds, int num_cmds)
+{
+	int i;
+
+	for (i = 0; i < num_cmds; i++) {
+		free(cmds[i].triangles);
+		free(cmds[i].trapezoids);
+		free_cmds(cmds[i].body, cmds[i].num_body);
+	}
+	free(cmds);
+}
+
+static void
+scene_bench_func(Display *dpy, void *data, int iterations)
+{
+	struct scene *s = data;
+	int i;
+
+	(void)dpy;
+	for (i = 0; i < iterations; i++)
+		run_cmds(s, s->cmds, s->num_cmds, 0, 0);
+}
+
+/* Loads the scene file at path and times it, reporting frames/s. */
+void
+scene_bench(Display *dpy, const char *path)
+{
+	struct bench_desc desc;
+	struct scene s;
+	FILE *file;
+	int i;
+
+	memset(&s, 0, sizeof(s));
+	s.path = path;
+	s.dpy = dpy;
+	s.mask_format = XRenderFindStandardFormat(dpy, PictStandardA8);
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		errx(1, "%s: %s", path, strerror(errno));
+	s.num_cmds = parse_block(&s, file, &s.cmds, false);
+	fclose(file);
+
+	desc.name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+	desc.func = scene_bench_func;
+	desc.data = &s;
+	desc.iterations = bench_iterations;
+	desc.units = 1;
+	desc.unit_name = "frames";
+	desc.pixels = count_pixels(s.cmds, s.num_cmds);
+	run_benchmark(dpy, &desc);
+
+	for (i = 0; i < s.num_pictures; i++) {
+		XRenderFreePicture(dpy, s.pictures[i].pict);
+		if (s.pictures[i].pixmap != None)
+			XFreePixmap(dpy, s.pictures[i].pixmap);
+		free(s.pictures[i].name);
+	}
+	free(s.pictures);
+	free_cmds(s.cmds, s.num_cmds);
+}
@@ -0,0 +1,562 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "rendercheck.h"
+
+/* With --jobs, the work items of do_tests() are dealt out round-robin to that
+ * many child processes, each with its own connection and fixtures.  A child's
+ * stdout goes to a temporary file, and it reports back through a pipe which
+ * byte ranges of that file belong to which work item, so that the parent can
+ * print the output of all items in the order a single process would have.
+ * Per-group measurements follow the segments in the report, so that the
+ * parent can print one table of them for all the jobs.
+ *
+ * Given a comma-separated list of displays, job k connects to display k modulo
+ * the number of displays, so the jobs can be spread over several X servers,
+ * possibly ones started with --xvfb.
+ */
+
+/* 0 means one job per display. */
+int num_jobs = 0;
+
+static pid_t *xvfb_pids;
+/* The process that started the servers, and so may stop them. */
+static pid_t xvfb_owner;
+static char **xvfb_displays;
+static int num_xvfb;
+
+struct shard_segment {
+	int item;
+	long start, end;
+};
+
+struct shard_report {
+	int tests_passed, tests_total, success_mask;
+	long preamble_end;
+	int num_segments;
+};
+
+static int shard_index;
+static int report_fd = -1;
+static int next_item;
+static long preamble_end = -1;
+static struct shard_segment *segments;
+static int num_segments, segments_allocated;
+static bool segment_open;
+
+static long
+output_offset(void)
+{
+	fflush(stdout);
+	return lseek(STDOUT_FILENO, 0, SEEK_CUR);
+}
+
+static void
+close_segment(long offset)
+{
+	if (segment_open) {
+		segments[num_segments - 1].end = offset;
+		segment_open = false;
+	}
+}
+
+/* Called before each work item of do_tests().  Returns whether this process
+ * should run it.
+ */
+bool
+shard_begin(void)
+{
+	int item = next_item++;
+	long offset;
+
+	if (num_jobs <= 1)
+		return true;
+
+	offset = output_offset();
+	if (preamble_end < 0)
+		preamble_end = offset;
+	close_segment(offset);
+
+	if (item % num_jobs != shard_index)
+		return false;
+
+	if (num_segments == segments_allocated) {
+		segments_allocated = segments_allocated ?
+		    segments_allocated * 2 : 64;
+		segments = realloc(segments,
+		    sizeof(*segments) * segments_allocated);
+		if (segments == NULL)
+			errx(1, "malloc error");
+	}
+	segments[num_segments].item = item;
+	segments[num_segments].start = offset;
+	num_segments++;
+	segment_open = true;
+
+	return true;
+}
+
+/* Picks where this job's window goes, so that the windows of jobs sharing a
+ * display don't cover each other: side by side, then in further rows.  With
+ * more jobs than fit on the screen, the extra ones wrap around and overlap.
+ */
+void
+shard_window_position(Display *dpy, int *x, int *y)
+{
+	int columns = max(DisplayWidth(dpy, DefaultScreen(dpy)) / win_width, 1);
+	int rows = max(DisplayHeight(dpy, DefaultScreen(dpy)) / win_height, 1);
+	int slot = shard_index;
+
+	if (slot >= columns * rows) {
+		fprintf(stderr, "Job %d's window overlaps another job's on "
+			"this display\n", shard_index);
+		slot %= columns * rows;
+	}
+
+	*x = slot % columns * win_width;
+	*y = slot / columns * win_height;
+}
+
+/* Returns whether this is the first job, or the only one. */
+bool
+shard_first(void)
+{
+	return shard_index == 0;
+}
+
+static void
+write_all(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+
+	while (size > 0) {
+		ssize_t written = write(fd, p, size);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			errx(1, "write: %s", strerror(errno));
+		}
+		p += written;
+		size -= written;
+	}
+}
+
+static bool
+read_all(int fd, void *data, size_t size)
+{
+	char *p = data;
+
+	while (size > 0) {
+		ssize_t got = read(fd, p, size);
+
+		if (got < 0 && errno == EINTR)
+			continue;
+		if (got <= 0)
+			return false;
+		p += got;
+		size -= got;
+	}
+	return true;
+}
+
+/* Appends data to this child's report, for the modules that report their
+ * measurements after the segments.
+ */
+void
+shard_write(const void *data, size_t size)
+{
+	write_all(report_fd, data, size);
+}
+
+void
+shard_write_string(const char *s)
+{
+	int len = strlen(s);
+
+	shard_write(&len, sizeof(len));
+	shard_write(s, len);
+}
+
+/* Reads data written by shard_write() in a child, returning false if the
+ * child died before writing it.
+ */
+bool
+shard_read(int fd, void *data, size_t size)
+{
+	return read_all(fd, data, size);
+}
+
+/* Returns a malloced copy of a string written by shard_write_string(), or
+ * NULL.
+ */
+char *
+shard_read_string(int fd)
+{
+	char *s;
+	int len;
+
+	if (!read_all(fd, &len, sizeof(len)) || len < 0)
+		return NULL;
+	s = malloc(len + 1);
+	if (s == NULL)
+		errx(1, "malloc error");
+	if (!read_all(fd, s, len)) {
+		free(s);
+		return NULL;
+	}
+	s[len] = '\0';
+	return s;
+}
+
+/* Called by a child at the end of do_tests() to hand its results to the
+ * parent.
+ */
+void
+shard_report(int tests_passed, int tests_total, int success_mask)
+{
+	struct shard_report report;
+	long offset = output_offset();
+
+	close_segment(offset);
+
+	report.tests_passed = tests_passed;
+	report.tests_total = tests_total;
+	report.success_mask = success_mask;
+	report.preamble_end = preamble_end < 0 ? offset : preamble_end;
+	report.num_segments = num_segments;
+
+	write_all(report_fd, &report, sizeof(report));
+	write_all(report_fd, segments, sizeof(*segments) * num_segments);
+	latency_send();
+	cpu_send();
+	perf_send();
+
+	free(segments);
+	segments = NULL;
+	num_segments = segments_allocated = 0;
+}
+
+static void
+copy_output(FILE *file, long start, long end)
+{
+	char buf[4096];
+
+	while (start < end) {
+		size_t len = min((size_t)(end - start), sizeof(buf));
+		ssize_t got = pread(fileno(file), buf, len, start);
+
+		if (got <= 0)
+			break;
+		fwrite(buf, 1, got, stdout);
+		start += got;
+	}
+}
+
+static int
+compare_segments(const void *a, const void *b)
+{
+	const struct shard_segment *sa = a, *sb = b;
+
+	return sa->item - sb->item;
+}
+
+struct shard_child {
+	pid_t pid;
+	FILE *output;
+	int report_fd;
+	struct shard_report report;
+	struct shard_segment *segments;
+	bool reported;
+};
+
+/* Returns the number of displays in a comma-separated list. */
+int
+count_displays(const char *display)
+{
+	int n = 1;
+
+	if (display == NULL)
+		return 1;
+	for (; *display; display++) {
+		if (*display == ',')
+			n++;
+	}
+	return n;
+}
+
+/* Starts n Xvfb servers and returns the comma-separated list of their
+ * displays.  They are terminated by stop_xvfb(), which also runs at exit so
+ * that an errx() doesn't leave them behind.
+ */
+char *
+start_xvfb(int n)
+{
+	char *display = NULL;
+	int i;
+
+	xvfb_pids = calloc(n, sizeof(*xvfb_pids));
+	xvfb_displays = calloc(n, sizeof(*xvfb_displays));
+	if (xvfb_pids == NULL || xvfb_displays == NULL)
+		errx(1, "malloc error");
+	xvfb_owner = getpid();
+	atexit(stop_xvfb);
+
+	fflush(stdout);
+	for (i = 0; i < n; i++) {
+		char fd_arg[16], buf[16], *list;
+		int fds[2], len = 0;
+
+		if (pipe(fds) != 0)
+			errx(1, "pipe: %s", strerror(errno));
+
+		xvfb_pids[i] = fork();
+		if (xvfb_pids[i] < 0)
+			errx(1, "fork: %s", strerror(errno));
+		if (xvfb_pids[i] == 0) {
+			close(fds[0]);
+			snprintf(fd_arg, sizeof(fd_arg), "%d", fds[1]);
+			execlp("Xvfb", "Xvfb", "-displayfd", fd_arg,
+			       "-screen", "0", "640x480x24", "-nolisten", "tcp",
+			       (char *)NULL);
+			fprintf(stderr, "Couldn't run Xvfb: %s\n",
+				strerror(errno));
+			_exit(127);
+		}
+		num_xvfb++;
+		close(fds[1]);
+
+		/* The server writes its display number once it's ready. */
+		while (len < (int)sizeof(buf) - 1) {
+			ssize_t got = read(fds[0], &buf[len], 1);
+
+			if (got < 0 && errno == EINTR)
+				continue;
+			if (got <= 0 || buf[len] == '\n')
+				break;
+			len++;
+		}
+		buf[len] = '\0';
+		close(fds[0]);
+		if (len == 0) {
+			stop_xvfb();
+			errx(1, "Xvfb failed to start.");
+		}
+
+		if (asprintf(&xvfb_displays[i], ":%s", buf) < 0 ||
+		    asprintf(&list, "%s%s:%s", display ? display : "",
+			     display ? "," : "", buf) < 0)
+			errx(1, "malloc error");
+		free(display);
+		display = list;
+	}
+
+	if (is_verbose)
+		printf("Started Xvfb on %s\n", display);
+
+	return display;
+}
+
+/* Returns the pid of the Xvfb started for display, or 0 if it isn't one. */
+pid_t
+xvfb_pid(const char *display)
+{
+	int i;
+
+	for (i = 0; display != NULL && i < num_xvfb; i++) {
+		if (strcmp(xvfb_displays[i], display) == 0)
+			return xvfb_pids[i];
+	}
+	return 0;
+}
+
+void
+stop_xvfb(void)
+{
+	int i;
+
+	/* The --jobs children exit through here too. */
+	if (getpid() != xvfb_owner)
+		return;
+
+	for (i = 0; i < num_xvfb; i++)
+		kill(xvfb_pids[i], SIGTERM);
+	for (i = 0; i < num_xvfb; i++) {
+		waitpid(xvfb_pids[i], NULL, 0);
+		free(xvfb_displays[i]);
+	}
+
+	free(xvfb_pids);
+	free(xvfb_displays);
+	xvfb_pids = NULL;
+	xvfb_displays = NULL;
+	num_xvfb = 0;
+}
+
+/* Runs run() in num_jobs child processes, each taking its share of the work
+ * items, then prints their merged output and results.  Returns the exit
+ * status for the program.
+ */
+int
+run_shards(int (*run)(const char *display), const char *display)
+{
+	struct shard_child *children;
+	struct shard_segment *all;
+	char **displays, *list = NULL, *next;
+	int i, j, n, status, num_displays;
+	int tests_passed = 0, tests_total = 0, success_mask = ~0;
+	bool ok = true;
+
+	num_displays = count_displays(display);
+	displays = calloc(num_displays, sizeof(*displays));
+	children = calloc(num_jobs, sizeof(*children));
+	if (displays == NULL || children == NULL)
+		errx(1, "malloc error");
+	if (display != NULL) {
+		list = strdup(display);
+		if (list == NULL)
+			errx(1, "malloc error");
+		next = list;
+		for (i = 0; i < num_displays; i++)
+			displays[i] = strsep(&next, ",");
+	}
+
+	fflush(stdout);
+	for (i = 0; i < num_jobs; i++) {
+		int fds[2];
+
+		children[i].output = tmpfile();
+		if (children[i].output == NULL)
+			errx(1, "tmpfile: %s", strerror(errno));
+		if (pipe(fds) != 0)
+			errx(1, "pipe: %s", strerror(errno));
+
+		children[i].pid = fork();
+		if (children[i].pid < 0)
+			errx(1, "fork: %s", strerror(errno));
+		if (children[i].pid == 0) {
+			close(fds[0]);
+			shard_index = i;
+			report_fd = fds[1];
+			if (dup2(fileno(children[i].output), STDOUT_FILENO) < 0)
+				errx(1, "dup2: %s", strerror(errno));
+			exit(run(displays[i % num_displays]));
+		}
+
+		close(fds[1]);
+		children[i].report_fd = fds[0];
+	}
+
+	/* Read the reports before reaping the children, since a child with a
+	 * long report blocks until its pipe is drained.
+	 */
+	n = 0;
+	for (i = 0; i < num_jobs; i++) {
+		struct shard_child *child = &children[i];
+		size_t size;
+
+		if (!read_all(child->report_fd, &child->report,
+			      sizeof(child->report))) {
+			close(child->report_fd);
+			continue;
+		}
+		size = sizeof(*child->segments) * child->report.num_segments;
+		child->segments = malloc(size);
+		if (child->segments == NULL)
+			errx(1, "malloc error");
+		child->reported = read_all(child->report_fd, child->segments,
+					   size) &&
+		    latency_receive(child->report_fd) &&
+		    cpu_receive(child->report_fd) &&
+		    perf_receive(child->report_fd);
+		close(child->report_fd);
+		if (child->reported)
+			n += child->report.num_segments;
+	}
+
+	for (i = 0; i < num_jobs; i++) {
+		if (waitpid(children[i].pid, &status, 0) < 0 ||
+		    !WIFEXITED(status) || !children[i].reported) {
+			fprintf(stderr, "Job %d did not complete\n", i);
+			ok = false;
+		}
+	}
+
+	all = malloc(sizeof(*all) * (n + 1));
+	if (all == NULL)
+		errx(1, "malloc error");
+	n = 0;
+	for (i = 0; i < num_jobs; i++) {
+		struct shard_child *child = &children[i];
+
+		if (!child->reported)
+			continue;
+		for (j = 0; j < child->report.num_segments; j++) {
+			all[n] = child->segments[j];
+			/* Remember which child's file it's in. */
+			all[n].item = all[n].item * num_jobs + i;
+			n++;
+		}
+		tests_passed += child->report.tests_passed;
+		tests_total += child->report.tests_total;
+		success_mask &= child->report.success_mask;
+	}
+	qsort(all, n, sizeof(*all), compare_segments);
+
+	/* The output before the first work item is the same in every child. */
+	for (i = 0; i < num_jobs; i++) {
+		if (children[i].reported) {
+			copy_output(children[i].output, 0,
+				    children[i].report.preamble_end);
+			break;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		copy_output(children[all[i].item % num_jobs].output,
+			    all[i].start, all[i].end);
+	}
+
+	latency_report();
+	cpu_report();
+	perf_report();
+	printf("%d tests passed of %d total\n", tests_passed, tests_total);
+	printf("Successful Groups:\n");
+	print_tests(stdout, success_mask);
+
+	for (i = 0; i < num_jobs; i++) {
+		fclose(children[i].output);
+		free(children[i].segments);
+	}
+	free(children);
+	free(all);
+	free(displays);
+	free(list);
+
+	return ok && tests_passed == tests_total ? 0 : 1;
+}
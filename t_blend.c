@@ -25,17 +25,166 @@
 
 #include "rendercheck.h"
 
-/* Test a composite of a given operation, source, and destination picture.  */
+/* The parameters of one blend_test() call, shared by its pages. */
+struct blend_args {
+	picture_info *dst;
+	const int *op;
+	int num_op;
+	const picture_info **src_color;
+	const picture_info **dst_color;
+	int num_dst;
+	color4d *srcs, *dsts, *results;
+};
+
+/* One page of tests: the first this_src sources against the destination colors
+ * [k0, k1), rendered and being read back.
+ */
+struct blend_page {
+	int k0, k1;
+	int this_src;
+	int rows;
+	struct pending_image readback;
+};
+
+/* Renders a page and starts reading it back, filling in k1 and rows. */
+static void
+render_page(Display *dpy, picture_info *win, const struct blend_args *args,
+	    struct blend_page *page)
+{
+	picture_info *dst = args->dst;
+	int i, j, iter, k1 = page->k0, y = 0;
+
+	for (iter = 0; iter < pixmap_move_iter; iter++) {
+		k1 = page->k0;
+		y = 0;
+		while (k1 < args->num_dst && y + page->this_src <= win_height) {
+			XRenderComposite(dpy, PictOpSrc,
+					 args->dst_color[k1++]->pict, 0, dst->pict,
+					 0, 0,
+					 0, 0,
+					 0, y,
+					 args->num_op, page->this_src);
+			for (j = 0; j < page->this_src; j++) {
+				for (i = 0; i < args->num_op; i++) {
+					XRenderComposite(dpy, ops[args->op[i]].op,
+							 args->src_color[j]->pict, 0, dst->pict,
+							 0, 0,
+							 0, 0,
+							 i, y,
+							 1, 1);
+				}
+				y++;
+			}
+		}
+	}
+	page->k1 = k1;
+	page->rows = y;
+
+	begin_get_image(dpy, &page->readback, dst, 0, 0, num_ops, y);
+	copy_pict_to_win(dpy, dst, win, win_width, win_height);
+}
+
+/* Waits for a page's readback and checks it against the expected results. */
+static bool
+verify_page(Display *dpy, const struct blend_args *args,
+	    struct blend_page *page)
+{
+	picture_info *dst = args->dst;
+	const picture_info **src_color = args->src_color;
+	const picture_info **dst_color = args->dst_color;
+	const int *op = args->op;
+	int num_op = args->num_op;
+	int this_src = page->this_src;
+	color4d *dsts = args->dsts, *results = args->results;
+	color4d *expected, *pixels;
+	char testname[20];
+	XImage *image;
+	int i, j, k, y;
+	bool success = true;
+
+	image = finish_get_image(dpy, &page->readback);
+
+	pixels = malloc(sizeof(color4d) * num_op * page->rows);
+	if (pixels == NULL)
+		errx(1, "malloc error");
+	get_pixels_from_image(image, dst, 0, 0, num_op, page->rows, pixels);
+	release_image(image);
+
+	y = 0;
+	for (k = page->k0; k < page->k1 && success; k++) {
+		XRenderDirectFormat dst_acc;
+
+		accuracy(&dst_acc,
+			 &dst->format->direct,
+			 &dst_color[k]->format->direct);
+
+		dsts[0] = dst_color[k]->color;
+		color_correct(dst, &dsts[0]);
+		for (j = 1; j < this_src; j++)
+			dsts[j] = dsts[0];
+
+		for (i = 0; i < num_op; i++) {
+			get_expected_batch(ops[op[i]].op,
+					   args->srcs, NULL, dsts,
+					   &results[i * this_src],
+					   this_src, false, dst);
+		}
+
+		for (j = 0; j < this_src && success; j++) {
+			XRenderDirectFormat acc;
+
+			accuracy(&acc, &src_color[j]->format->direct, &dst_acc);
+
+			for (i = 0; i < num_op; i++) {
+				color4d *tested = &pixels[y * num_op + i];
+
+				expected = &results[i * this_src + j];
+				if (eval_diff(&acc, expected, tested) > 3.) {
+					char *srcformat;
+
+					snprintf(testname, 20, "%s blend", ops[op[i]].name);
+					describe_format(&srcformat, NULL, src_color[j]->format);
+					print_fail(testname, expected, tested, 0, 0,
+						   eval_diff(&acc, expected, tested));
+					printf("src color: %.2f %.2f %.2f %.2f (%s)\n"
+					       "dst color: %.2f %.2f %.2f %.2f\n",
+					       src_color[j]->color.r, src_color[j]->color.g,
+					       src_color[j]->color.b, src_color[j]->color.a,
+					       srcformat,
+					       dst_color[k]->color.r,
+					       dst_color[k]->color.g,
+					       dst_color[k]->color.b,
+					       dst_color[k]->color.a);
+					printf("src: %s, dst: %s\n", src_color[j]->name, dst->name);
+					free(srcformat);
+					success = false;
+					break;
+				}
+			}
+			y++;
+		}
+	}
+
+	free(pixels);
+	return success;
+}
+
+/* Test a composite of a given operation, source, and destination picture.
+ *
+ * Each page is verified only once the next one has been rendered and its
+ * readback requested, so the server renders while the client verifies.
+ */
 bool
 blend_test(Display *dpy, picture_info *win, picture_info *dst,
 	   const int *op, int num_op,
 	   const picture_info **src_color, int num_src,
 	   const picture_info **dst_color, int num_dst)
 {
-	color4d expected, tested, tdst;
-	char testname[20];
-	int i, j, k, y, iter;
+	struct blend_args args;
+	struct blend_page pages[2], *cur = pages, *prev = NULL;
+	int j, k, n = 0;
 	int page, num_pages;
+	bool success = true;
 
 	/* If the window is smaller than the number of sources to test,
 	 * we need to break the sources up into pages.
@@ -44,100 +193,47 @@ blend_test(Display *dpy, picture_info *win, picture_info *dst,
 	 */
 	num_pages = num_src / win_height + 1;
 
-	k = y = 0;
-	while (k < num_dst) {
-	    XImage *image;
-	    int k0 = k, k1 = k;
-	    int this_src, rem_src;
+	args.dst = dst;
+	args.op = op;
+	args.num_op = num_op;
+	args.src_color = src_color;
+	args.dst_color = dst_color;
+	args.num_dst = num_dst;
+	args.srcs = malloc(sizeof(color4d) * num_src);
+	args.dsts = malloc(sizeof(color4d) * num_src);
+	args.results = malloc(sizeof(color4d) * num_op * num_src);
+	if (args.srcs == NULL || args.dsts == NULL || args.results == NULL)
+		errx(1, "malloc error");
+	for (j = 0; j < num_src; j++)
+		args.srcs[j] = src_color[j]->color;
+
+	k = 0;
+	while (k < num_dst && success) {
+	    int rem_src = num_src;
 
-	    rem_src = num_src;
 	    for (page = 0; page < num_pages; page++) {
-		    this_src = rem_src / (num_pages - page);
-		    for (iter = 0; iter < pixmap_move_iter; iter++) {
-			    k1 = k0;
-			    y = 0;
-			    while (k1 < num_dst && y + this_src <= win_height) {
-				    XRenderComposite(dpy, PictOpSrc,
-						     dst_color[k1++]->pict, 0, dst->pict,
-						     0, 0,
-						     0, 0,
-						     0, y,
-						     num_op, this_src);
-				    for (j = 0; j < this_src; j++) {
-					    for (i = 0; i < num_op; i++) {
-						    XRenderComposite(dpy, ops[op[i]].op,
-								     src_color[j]->pict, 0, dst->pict,
-								     0, 0,
-								     0, 0,
-								     i, y,
-								     1, 1);
-					    }
-					    y++;
-				    }
-			    }
+		    cur = &pages[n++ & 1];
+		    cur->k0 = k;
+		    cur->this_src = rem_src / (num_pages - page);
+		    render_page(dpy, win, &args, cur);
+
+		    if (prev != NULL && !verify_page(dpy, &args, prev)) {
+			    release_image(finish_get_image(dpy, &cur->readback));
+			    prev = NULL;
+			    success = false;
+			    break;
 		    }
-
-		    image = XGetImage(dpy, dst->d,
-				      0, 0, num_ops, y,
-				      0xffffffff, ZPixmap);
-		    copy_pict_to_win(dpy, dst, win, win_width, win_height);
-
-		    y = 0;
-		    for (k = k0; k < k1; k++) {
-			    XRenderDirectFormat dst_acc;
-
-			    accuracy(&dst_acc,
-				     &dst->format->direct,
-				     &dst_color[k]->format->direct);
-
-			    tdst = dst_color[k]->color;
-			    color_correct(dst, &tdst);
-
-			    for (j = 0; j < this_src; j++) {
-				    XRenderDirectFormat acc;
-
-				    accuracy(&acc, &src_color[j]->format->direct, &dst_acc);
-
-				    for (i = 0; i < num_op; i++) {
-					    get_pixel_from_image(image, dst, i, y, &tested);
-
-					    do_composite(ops[op[i]].op,
-							 &src_color[j]->color,
-							 NULL,
-							 &tdst,
-							 &expected,
-							 false);
-					    color_correct(dst, &expected);
-
-					    if (eval_diff(&acc, &expected, &tested) > 3.) {
-						    char *srcformat;
-
-						    snprintf(testname, 20, "%s blend", ops[op[i]].name);
-						    describe_format(&srcformat, NULL, src_color[j]->format);
-						    print_fail(testname, &expected, &tested, 0, 0,
-							       eval_diff(&acc, &expected, &tested));
-						    printf("src color: %.2f %.2f %.2f %.2f (%s)\n"
-							   "dst color: %.2f %.2f %.2f %.2f\n",
-							   src_color[j]->color.r, src_color[j]->color.g,
-							   src_color[j]->color.b, src_color[j]->color.a,
-							   srcformat,
-							   dst_color[k]->color.r,
-							   dst_color[k]->color.g,
-							   dst_color[k]->color.b,
-							   dst_color[k]->color.a);
-						    printf("src: %s, dst: %s\n", src_color[j]->name, dst->name);
-						    free(srcformat);
-						    return false;
-					    }
-				    }
-				    y++;
-			    }
-		    }
-
-		    XDestroyImage(image);
-		    rem_src -= this_src;
+		    prev = cur;
+		    rem_src -= cur->this_src;
 	    }
+	    k = cur->k1;
 	}
 
-	return true;
+	if (prev != NULL)
+		success = verify_page(dpy, &args, prev);
+
+	free(args.srcs);
+	free(args.dsts);
+	free(args.results);
+	return success;
 }
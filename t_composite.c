@@ -21,11 +21,182 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
 
 #include "rendercheck.h"
 
+/* The parameters of one composite_test() call, shared by its pages. */
+struct composite_args {
+	picture_info *dst;
+	const int *op;
+	int num_op;
+	const picture_info **src_color;
+	const picture_info **mask_color;
+	const picture_info **dst_color;
+	bool componentAlpha;
+	color4d *srcs, *msks, *dsts, *results, *pixels;
+};
+
+/* One page of tests: the first this_src sources through mask m onto
+ * destination color d, rendered and being read back.
+ */
+struct composite_page {
+	int d, m;
+	int this_src;
+	struct pending_image readback;
+};
+
+/* Renders a page and starts reading it back. */
+static void
+render_page(Display *dpy, picture_info *win, const struct composite_args *args,
+	    struct composite_page *page)
+{
+	picture_info *dst = args->dst;
+	const picture_info *mask = args->mask_color[page->m];
+	int i, s, iter;
+
+	if (args->componentAlpha) {
+	    XRenderPictureAttributes pa;
+
+	    pa.component_alpha = true;
+	    XRenderChangePicture(dpy, mask->pict, CPComponentAlpha, &pa);
+	}
+
+	for (iter = 0; iter < pixmap_move_iter; iter++) {
+	    XRenderComposite(dpy, PictOpSrc,
+			     args->dst_color[page->d]->pict, 0, dst->pict,
+			     0, 0,
+			     0, 0,
+			     0, 0,
+			     args->num_op, page->this_src);
+	    for (s = 0; s < page->this_src; s++) {
+		for (i = 0; i < args->num_op; i++)
+		    XRenderComposite(dpy, ops[args->op[i]].op,
+				     args->src_color[s]->pict,
+				     mask->pict,
+				     dst->pict,
+				     0, 0,
+				     0, 0,
+				     i, s,
+				     1, 1);
+	    }
+	}
+
+	if (args->componentAlpha) {
+	    XRenderPictureAttributes pa;
+
+	    pa.component_alpha = false;
+	    XRenderChangePicture(dpy, mask->pict, CPComponentAlpha, &pa);
+	}
+
+	begin_get_image(dpy, &page->readback, dst, 0, 0, args->num_op,
+			page->this_src);
+	copy_pict_to_win(dpy, dst, win, win_width, win_height);
+}
+
+/* Waits for a page's readback and checks it against the expected results. */
+static bool
+verify_page(Display *dpy, const struct composite_args *args,
+	    struct composite_page *page)
+{
+	picture_info *dst = args->dst;
+	const picture_info **src_color = args->src_color;
+	const picture_info *mask = args->mask_color[page->m];
+	const picture_info *dst_color = args->dst_color[page->d];
+	const int *op = args->op;
+	int num_op = args->num_op;
+	int this_src = page->this_src;
+	bool componentAlpha = args->componentAlpha;
+	color4d *msks = args->msks, *dsts = args->dsts;
+	color4d *results = args->results, *pixels = args->pixels;
+	color4d *expected, tmsk;
+	XRenderDirectFormat mask_acc;
+	char testname[40];
+	XImage *image;
+	int i, s;
+
+	image = finish_get_image(dpy, &page->readback);
+	get_pixels_from_image(image, dst, 0, 0, num_op, this_src, pixels);
+	release_image(image);
+
+	dsts[0] = dst_color->color;
+	color_correct(dst, &dsts[0]);
+	for (s = 1; s < this_src; s++)
+	    dsts[s] = dsts[0];
+
+	if (componentAlpha && mask->format->direct.redMask == 0) {
+	    /* Ax component-alpha masks expand alpha into
+	     * all color channels.
+	     * XXX: This should be located somewhere generic.
+	     */
+	    tmsk.a = mask->color.a;
+	    tmsk.r = mask->color.a;
+	    tmsk.g = mask->color.a;
+	    tmsk.b = mask->color.a;
+	} else
+	    tmsk = mask->color;
+	for (s = 0; s < this_src; s++)
+	    msks[s] = tmsk;
+
+	for (i = 0; i < num_op; i++) {
+	    get_expected_batch(ops[op[i]].op, args->srcs, msks, dsts,
+			       &results[i * this_src], this_src,
+			       componentAlpha, dst);
+	}
+
+	accuracy(&mask_acc,
+		 &mask->format->direct,
+		 &dst_color->format->direct);
+	accuracy(&mask_acc, &mask_acc, &dst->format->direct);
+
+	for (s = 0; s < this_src; s++) {
+	    XRenderDirectFormat acc;
+
+	    accuracy(&acc, &mask_acc, &src_color[s]->format->direct);
+
+	    for (i = 0; i < num_op; i++) {
+		color4d *tested = &pixels[s * num_op + i];
+
+		expected = &results[i * this_src + s];
+		if (eval_diff(&acc, expected, tested) > 3.) {
+		    snprintf(testname, 40,
+			     "%s %scomposite", ops[op[i]].name,
+			     componentAlpha ? "CA " : "");
+		    print_fail(testname, expected, tested, 0, 0,
+			       eval_diff(&acc, expected, tested));
+		    printf("src color: %.2f %.2f %.2f %.2f\n"
+			   "msk color: %.2f %.2f %.2f %.2f\n"
+			   "dst color: %.2f %.2f %.2f %.2f\n",
+			   src_color[s]->color.r,
+			   src_color[s]->color.g,
+			   src_color[s]->color.b,
+			   src_color[s]->color.a,
+			   mask->color.r,
+			   mask->color.g,
+			   mask->color.b,
+			   mask->color.a,
+			   dst_color->color.r,
+			   dst_color->color.g,
+			   dst_color->color.b,
+			   dst_color->color.a);
+		    printf("src: %s, mask: %s, dst: %s\n",
+			   src_color[s]->name,
+			   mask->name,
+			   dst->name);
+		    return false;
+		}
+	    }
+	}
+
+	return true;
+}
+
 /* Test a composite of a given operation, source, mask, and destination picture.
  * Fills the window, and samples from the 0,0 pixel corner.
+ *
+ * Each page is verified only once the next one has been rendered and its
+ * readback requested, so the server renders while the client verifies.
  */
 bool
 composite_test(Display *dpy, picture_info *win, picture_info *dst,
@@ -35,10 +206,11 @@ composite_test(Display *dpy, picture_info *win, picture_info *dst,
 	       const picture_info **dst_color, int num_dst,
 	       bool componentAlpha)
 {
-	color4d expected, tested, tdst, tmsk;
-	char testname[40];
-	int i, s, m, d, iter;
+	struct composite_args args;
+	struct composite_page pages[2], *cur, *prev = NULL;
+	int s, m, d, n = 0;
 	int page, num_pages;
+	bool success = true;
 
 	/* If the window is smaller than the number of sources to test,
 	 * we need to break the sources up into pages.
@@ -47,125 +219,289 @@ composite_test(Display *dpy, picture_info *win, picture_info *dst,
 	 */
 	num_pages = num_src / win_height + 1;
 
-	for (d = 0; d < num_dst; d++) {
-	    tdst = dst_color[d]->color;
-	    color_correct(dst, &tdst);
+	args.dst = dst;
+	args.op = op;
+	args.num_op = num_op;
+	args.src_color = src_color;
+	args.mask_color = mask_color;
+	args.dst_color = dst_color;
+	args.componentAlpha = componentAlpha;
+	args.pixels = malloc(sizeof(color4d) * num_op * min(num_src, win_height));
+	args.srcs = malloc(sizeof(color4d) * num_src);
+	args.msks = malloc(sizeof(color4d) * num_src);
+	args.dsts = malloc(sizeof(color4d) * num_src);
+	args.results = malloc(sizeof(color4d) * num_op * num_src);
+	if (args.pixels == NULL || args.srcs == NULL || args.msks == NULL ||
+	    args.dsts == NULL || args.results == NULL)
+		errx(1, "malloc error");
+	for (s = 0; s < num_src; s++)
+		args.srcs[s] = src_color[s]->color;
 
-	    for (m = 0; m < num_mask; m++) {
-		XRenderDirectFormat mask_acc;
-		int this_src, rem_src;
-		XImage *image;
+	for (d = 0; d < num_dst && success; d++) {
+	    for (m = 0; m < num_mask && success; m++) {
+		int rem_src = num_src;
 
-		if (componentAlpha) {
-		    XRenderPictureAttributes pa;
+		for (page = 0; page < num_pages; page++) {
+		    cur = &pages[n++ & 1];
+		    cur->d = d;
+		    cur->m = m;
+		    cur->this_src = rem_src / (num_pages - page);
+		    render_page(dpy, win, &args, cur);
 
-		    pa.component_alpha = true;
-		    XRenderChangePicture(dpy, mask_color[m]->pict,
-					 CPComponentAlpha, &pa);
+		    if (prev != NULL && !verify_page(dpy, &args, prev)) {
+			release_image(finish_get_image(dpy, &cur->readback));
+			prev = NULL;
+			success = false;
+			break;
+		    }
+		    prev = cur;
+		    rem_src -= cur->this_src;
 		}
+	    }
+	}
 
-		rem_src = num_src;
-		for (page = 0; page < num_pages; page++) {
-		    this_src = rem_src / (num_pages - page);
-		    for (iter = 0; iter < pixmap_move_iter; iter++) {
-			XRenderComposite(dpy, PictOpSrc,
-					 dst_color[d]->pict, 0, dst->pict,
-					 0, 0,
-					 0, 0,
-					 0, 0,
-					 num_op, this_src);
-			for (s = 0; s < this_src; s++) {
-			    for (i = 0; i < num_op; i++)
-				XRenderComposite(dpy, ops[op[i]].op,
-						 src_color[s]->pict,
-						 mask_color[m]->pict,
-						 dst->pict,
-						 0, 0,
-						 0, 0,
-						 i, s,
-						 1, 1);
-			}
-		    }
+	if (prev != NULL)
+	    success = verify_page(dpy, &args, prev);
 
-		    if (componentAlpha) {
-			XRenderPictureAttributes pa;
+	free(args.pixels);
+	free(args.srcs);
+	free(args.msks);
+	free(args.dsts);
+	free(args.results);
+	return success;
+}
 
-			pa.component_alpha = false;
-			XRenderChangePicture(dpy, mask_color[m]->pict,
-					     CPComponentAlpha, &pa);
-		    }
+struct composite_bench {
+	int op;
+	const picture_info *src, *mask, *dst;
+	int size;
+};
+
+static void
+composite_bench_func(Display *dpy, void *data, int iterations)
+{
+	struct composite_bench *b = data;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		XRenderComposite(dpy, b->op, b->src->pict,
+				 b->mask ? b->mask->pict : None, b->dst->pict,
+				 0, 0, 0, 0, 0, 0, b->size, b->size);
+	}
+}
+
+/* Times compositing of each op, source and mask (NULL for none) to dst at a
+ * few sizes, printing composites/s and Mpixels/s for each.
+ */
+void
+composite_bench(Display *dpy, picture_info *dst,
+		const int *op, int num_op,
+		const picture_info **src, int num_src,
+		const picture_info **mask, int num_mask)
+{
+	static const int sizes[] = { 1, 10, 40 };
+	struct composite_bench b;
+	struct bench_desc desc;
+	char name[80];
+	int i, s, m;
+	unsigned int z;
+
+	b.dst = dst;
 
-		    image = XGetImage(dpy, dst->d,
-				      0, 0, num_op, this_src,
-				      0xffffffff, ZPixmap);
-		    copy_pict_to_win(dpy, dst, win, win_width, win_height);
-
-		    if (componentAlpha &&
-			mask_color[m]->format->direct.redMask == 0) {
-			/* Ax component-alpha masks expand alpha into
-			 * all color channels.
-			 * XXX: This should be located somewhere generic.
-			 */
-			tmsk.a = mask_color[m]->color.a;
-			tmsk.r = mask_color[m]->color.a;
-			tmsk.g = mask_color[m]->color.a;
-			tmsk.b = mask_color[m]->color.a;
-		    } else
-			tmsk = mask_color[m]->color;
-
-		    accuracy(&mask_acc,
-			     &mask_color[m]->format->direct,
-			     &dst_color[d]->format->direct);
-		    accuracy(&mask_acc, &mask_acc, &dst->format->direct);
-
-		    for (s = 0; s < this_src; s++) {
-			XRenderDirectFormat acc;
-
-			accuracy(&acc, &mask_acc, &src_color[s]->format->direct);
-
-			for (i = 0; i < num_op; i++) {
-			    get_pixel_from_image(image, dst, i, s, &tested);
-
-			    do_composite(ops[op[i]].op,
-					 &src_color[s]->color, &tmsk, &tdst,
-					 &expected, componentAlpha);
-			    color_correct(dst, &expected);
-
-			    if (eval_diff(&acc, &expected, &tested) > 3.) {
-				snprintf(testname, 40,
-					 "%s %scomposite", ops[op[i]].name,
-					 componentAlpha ? "CA " : "");
-				print_fail(testname, &expected, &tested, 0, 0,
-					   eval_diff(&acc, &expected, &tested));
-				printf("src color: %.2f %.2f %.2f %.2f\n"
-				       "msk color: %.2f %.2f %.2f %.2f\n"
-				       "dst color: %.2f %.2f %.2f %.2f\n",
-				       src_color[s]->color.r,
-				       src_color[s]->color.g,
-				       src_color[s]->color.b,
-				       src_color[s]->color.a,
-				       mask_color[m]->color.r,
-				       mask_color[m]->color.g,
-				       mask_color[m]->color.b,
-				       mask_color[m]->color.a,
-				       dst_color[d]->color.r,
-				       dst_color[d]->color.g,
-				       dst_color[d]->color.b,
-				       dst_color[d]->color.a);
-				printf("src: %s, mask: %s, dst: %s\n",
-				       src_color[s]->name,
-				       mask_color[m]->name,
-				       dst->name);
-				XDestroyImage(image);
-				return false;
-			    }
-			}
+	desc.name = name;
+	desc.func = composite_bench_func;
+	desc.data = &b;
+	desc.iterations = bench_iterations;
+	desc.units = 1;
+	desc.unit_name = "composites";
+
+	for (i = 0; i < num_op; i++) {
+	    b.op = ops[op[i]].op;
+	    for (s = 0; s < num_src; s++) {
+		b.src = src[s];
+		for (m = 0; m < num_mask; m++) {
+		    b.mask = mask[m];
+		    for (z = 0; z < ARRAY_SIZE(sizes); z++) {
+			b.size = min(sizes[z], min(win_width, win_height));
+			desc.pixels = b.size * b.size;
+			snprintf(name, sizeof(name), "%s %s / %s %dx%d -> %s",
+				 ops[op[i]].name, src[s]->name,
+				 mask[m] ? mask[m]->name : "none",
+				 b.size, b.size, dst->name);
+			run_benchmark(dpy, &desc);
 		    }
-		    XDestroyImage(image);
-		    rem_src -= this_src;
 		}
 	    }
 	}
+}
 
-	return true;
+/* Largest size, in each dimension, of the size sweep benchmark. */
+#define SWEEP_MAX_SIZE	4096
+
+/* Fits t = a + b * pixels to the sweep timings by least squares, weighting
+ * each point by 1/t^2 so the small sizes count as much as the large ones.
+ */
+static void
+fit_sweep(const double *pixels, const double *t, int n, double *a, double *b)
+{
+	double sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, det;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		double w = 1 / (t[i] * t[i]);
+
+		sw += w;
+		sx += w * pixels[i];
+		sy += w * t[i];
+		sxx += w * pixels[i] * pixels[i];
+		sxy += w * pixels[i] * t[i];
+	}
+
+	det = sw * sxx - sx * sx;
+	if (det == 0) {
+		*a = *b = 0;
+		return;
+	}
+	*a = (sxx * sy - sx * sxy) / det;
+	*b = (sw * sxy - sx * sy) / det;
+}
+
+/* Times each op compositing each of the 1x1R sources onto a destination of
+ * the given format, at square sizes from 1x1 up to SWEEP_MAX_SIZE.  A linear
+ * fit of the timings splits them into per-request and per-pixel cost, and the
+ * size where the two are equal is reported as the crossover.
+ */
+void
+composite_size_bench(Display *dpy, XRenderPictFormat *dst_format,
+		     const int *op, int num_op,
+		     const picture_info **src, int num_src)
+{
+	double pixels[32], t[32];
+	struct composite_bench b;
+	struct bench_desc desc;
+	picture_info dst;
+	char name[80], *dst_name;
+	int i, s, n, size;
+
+	dst.format = dst_format;
+	dst.d = XCreatePixmap(dpy, DefaultRootWindow(dpy), SWEEP_MAX_SIZE,
+			      SWEEP_MAX_SIZE, dst_format->depth);
+	dst.pict = XRenderCreatePicture(dpy, dst.d, dst_format, 0, NULL);
+	describe_format(&dst_name, NULL, dst_format);
+
+	b.dst = &dst;
+	b.mask = NULL;
+
+	desc.name = name;
+	desc.func = composite_bench_func;
+	desc.data = &b;
+	desc.units = 1;
+	desc.unit_name = "composites";
+
+	for (i = 0; i < num_op; i++) {
+	    b.op = ops[op[i]].op;
+	    for (s = 0; s < num_src; s++) {
+		double a, c;
+
+		b.src = src[s];
+		n = 0;
+		for (size = 1; size <= SWEEP_MAX_SIZE; size *= 2) {
+		    b.size = size;
+		    desc.pixels = (double)size * size;
+		    /* Keep the big sizes from taking forever. */
+		    desc.iterations = max(2, min(bench_iterations,
+						 (1 << 24) / (size * size)));
+		    snprintf(name, sizeof(name), "%s %s -> %s %dx%d",
+			     ops[op[i]].name, src[s]->name, dst_name,
+			     size, size);
+		    pixels[n] = desc.pixels;
+		    t[n] = run_benchmark(dpy, &desc);
+		    n++;
+		}
+
+		fit_sweep(pixels, t, n, &a, &c);
+		printf("%s %s -> %s: %.3f us/request + %.3f ns/pixel",
+		       ops[op[i]].name, src[s]->name, dst_name,
+		       a * 1e6, c * 1e9);
+		if (a > 0 && c > 0) {
+		    double crossover = sqrt(a / c);
+
+		    printf(", crossover at %.0fx%.0f\n", crossover, crossover);
+		} else {
+		    printf(", no crossover\n");
+		}
+	    }
+	}
+
+	free(dst_name);
+	XRenderFreePicture(dpy, dst.pict);
+	XFreePixmap(dpy, dst.d);
+}
+
+/* Shortest warm-up curve measured, when --iter asks for fewer iterations. */
+#define WARMUP_MIN_ITER	32
+
+/* Measures the warm-up curve of each op compositing a freshly created ARGB32
+ * pixmap onto a freshly created one of the given format, as the tests do with
+ * their short-lived pixmaps, at the test size and at a size more likely to be
+ * worth migrating.
+ */
+void
+composite_warmup_bench(Display *dpy, XRenderPictFormat *dst_format,
+		       const int *op, int num_op)
+{
+	static const int sizes[] = { 40, 256 };
+	XRenderPictFormat *argb32_format =
+	    XRenderFindStandardFormat(dpy, PictStandardARGB32);
+	XRenderColor color = { 0x8000, 0x4000, 0x2000, 0x8000 };
+	struct composite_bench b;
+	struct bench_desc desc;
+	picture_info src, dst;
+	char name[80], *dst_name;
+	unsigned int z;
+	int i;
+
+	src.format = argb32_format;
+	dst.format = dst_format;
+	describe_format(&dst_name, NULL, dst_format);
+
+	b.src = &src;
+	b.mask = NULL;
+	b.dst = &dst;
+
+	desc.name = name;
+	desc.func = composite_bench_func;
+	desc.data = &b;
+	desc.units = 1;
+	desc.unit_name = "composites";
+
+	for (i = 0; i < num_op; i++) {
+	    b.op = ops[op[i]].op;
+	    for (z = 0; z < ARRAY_SIZE(sizes); z++) {
+		b.size = sizes[z];
+		desc.pixels = b.size * b.size;
+
+		src.d = XCreatePixmap(dpy, DefaultRootWindow(dpy), b.size,
+				      b.size, argb32_format->depth);
+		src.pict = XRenderCreatePicture(dpy, src.d, argb32_format, 0,
+						NULL);
+		XRenderFillRectangle(dpy, PictOpSrc, src.pict, &color, 0, 0,
+				     b.size, b.size);
+		dst.d = XCreatePixmap(dpy, DefaultRootWindow(dpy), b.size,
+				      b.size, dst_format->depth);
+		dst.pict = XRenderCreatePicture(dpy, dst.d, dst_format, 0,
+						NULL);
+
+		snprintf(name, sizeof(name), "%s %dx%d -> %s",
+			 ops[op[i]].name, b.size, b.size, dst_name);
+		run_warmup(dpy, &desc, max(pixmap_move_iter, WARMUP_MIN_ITER));
+
+		XRenderFreePicture(dpy, src.pict);
+		XFreePixmap(dpy, src.d);
+		XRenderFreePicture(dpy, dst.pict);
+		XFreePixmap(dpy, dst.d);
+	    }
+	}
+
+	free(dst_name);
 }
@@ -37,7 +37,7 @@ bool
 dstcoords_test(Display *dpy, picture_info *win, int op, picture_info *dst,
     picture_info *bg, picture_info *fg)
 {
-	color4d expected, tested;
+	color4d expected, pixels[5][5];
 	XImage *image;
 	int x, y, i;
 	bool failed = false;
@@ -51,29 +51,28 @@ dstcoords_test(Display *dpy, picture_info *win, int op, picture_info *dst,
 
 	copy_pict_to_win(dpy, dst, win, TEST_WIDTH, TEST_HEIGHT);
 
-	image = XGetImage(dpy, dst->d,
-			  0, 0, 5, 5,
-			  ~0U, ZPixmap);
+	image = get_image(dpy, dst, 0, 0, 5, 5);
+	get_pixels_from_image(image, dst, 0, 0, 5, 5, &pixels[0][0]);
+	release_image(image);
 
 	for (x = 0; x < 5; x++) {
 		for (y = 0; y < 5; y++) {
-			get_pixel_from_image(image, dst, x, y, &tested);
+			color4d *tested = &pixels[y][x];
+
 			if ((x >= 1 && x <= 3) && (y >= 1 && y <= 3))
 				expected = fg->color;
 			else
 				expected = bg->color;
 
 			color_correct(dst, &expected);
-			if (eval_diff(&dst->format->direct, &expected, &tested) > 2.0) {
+			if (eval_diff(&dst->format->direct, &expected, tested) > 2.0) {
 			    print_fail("dst coords",
-				       &expected, &tested, x, y,
-				       eval_diff(&dst->format->direct, &expected, &tested));
+				       &expected, tested, x, y,
+				       eval_diff(&dst->format->direct, &expected, tested));
 				failed = true;
 			}
 		}
 	}
 
-	XDestroyImage(image);
-
 	return !failed;
 }
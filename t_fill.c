@@ -26,25 +26,91 @@
 
 #include "rendercheck.h"
 
-/* Test that filling of the 1x1 repeating pictures worked as expected.  This is
- * pretty basic to most of the tests.
+/* Checks every size x size pixel of one fixture against its fill color,
+ * reporting the first mismatch.
  */
-bool
-fill_test(Display *dpy, picture_info *win, picture_info *src)
+static bool
+check_fill(picture_info *src, color4d *pixels, int stride, int size)
 {
-	color4d tested;
-	char *name;
-
-	get_pixel(dpy, src, 0, 0, &tested);
-	copy_pict_to_win(dpy, src, win, win_width, win_height);
-
-	if (eval_diff(&src->format->direct, &src->color, &tested) > 2.) {
-	    describe_format(&name, "fill ", src->format);
-	    print_fail(name, &src->color, &tested, 0, 0,
-		       eval_diff(&src->format->direct, &src->color, &tested));
-	    free(name);
-	    return false;
+	int x, y;
+
+	for (y = 0; y < size; y++) {
+		for (x = 0; x < size; x++) {
+			color4d *tested = &pixels[y * stride + x];
+			double diff;
+			char *name;
+
+			diff = eval_diff(&src->format->direct, &src->color,
+			    tested);
+			if (diff <= 2.)
+				continue;
+
+			describe_format(&name, "fill ", src->format);
+			print_fail(name, &src->color, tested, x, y, diff);
+			free(name);
+			return false;
+		}
 	}
 
 	return true;
 }
+
+/* Test that filling of the num_colors * nformats pictures (indexed like
+ * pictures_1x1 and pictures_10x10) worked as expected.  This is pretty basic to
+ * most of the tests.
+ *
+ * Rather than reading back each picture on its own, the pictures of each format
+ * are copied side by side into an atlas of that format, which is read back with
+ * a single image.  The result for pictures[i] is stored in ok[i].
+ */
+bool
+fill_test(Display *dpy, picture_info *win, picture_info *pictures, int size,
+    bool *ok)
+{
+	picture_info atlas;
+	color4d *pixels;
+	int atlas_width = num_colors * size;
+	int i, f;
+	bool success = true;
+
+	pixels = malloc(sizeof(color4d) * atlas_width * size);
+	if (pixels == NULL)
+		errx(1, "malloc error");
+
+	for (f = 0; f < nformats; f++) {
+		XImage *image;
+
+		atlas.format = pictures[f].format;
+		atlas.d = XCreatePixmap(dpy, DefaultRootWindow(dpy),
+		    atlas_width, size, atlas.format->depth);
+		atlas.pict = XRenderCreatePicture(dpy, atlas.d, atlas.format,
+		    0, NULL);
+
+		for (i = 0; i < num_colors; i++) {
+			XRenderComposite(dpy, PictOpSrc,
+			    pictures[i * nformats + f].pict, 0, atlas.pict,
+			    0, 0, 0, 0, i * size, 0, size, size);
+		}
+
+		image = get_image(dpy, &atlas, 0, 0, atlas_width, size);
+		copy_pict_to_win(dpy, &atlas, win, atlas_width, size);
+		get_pixels_from_image(image, &atlas, 0, 0, atlas_width, size,
+		    pixels);
+		release_image(image);
+
+		for (i = 0; i < num_colors; i++) {
+			int p = i * nformats + f;
+
+			ok[p] = check_fill(&pictures[p], &pixels[i * size],
+			    atlas_width, size);
+			success = success && ok[p];
+		}
+
+		XRenderFreePicture(dpy, atlas.pict);
+		XFreePixmap(dpy, atlas.d);
+	}
+
+	free(pixels);
+
+	return success;
+}
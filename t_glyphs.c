@@ -0,0 +1,478 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "rendercheck.h"
+
+/** @file t_glyphs.c
+ *
+ * Tests and benchmarks glyph rendering with XRenderCompositeString and
+ * XRenderCompositeText, using synthetic glyphs uploaded to A1, A8 and ARGB32
+ * glyphsets.
+ */
+
+#define GLYPH_WIDTH	8
+#define GLYPH_HEIGHT	12
+
+/* Number of glyphs drawn in a string by the test. */
+#define TEST_GLYPHS	4
+
+/* Where the test's string starts, leaving untouched pixels around it. */
+#define TEST_X		2
+#define TEST_Y		2
+
+enum glyph_kind {
+	GLYPH_A1,
+	GLYPH_A8,
+	GLYPH_ARGB32,
+};
+
+static const struct {
+	int standard_format;
+	const char *name;
+} glyph_kinds[] = {
+	[GLYPH_A1] = { PictStandardA1, "a1" },
+	[GLYPH_A8] = { PictStandardA8, "a8" },
+	[GLYPH_ARGB32] = { PictStandardARGB32, "a8r8g8b8" },
+};
+
+/* Returns the premultiplied a, r, g, b of pixel (x, y) of glyph g, on a 0 to
+ * 255 scale.  A1 and A8 glyphs have the same value in all channels.
+ */
+static void
+glyph_pixel(enum glyph_kind kind, unsigned int g, int x, int y,
+	    uint8_t argb[4])
+{
+	unsigned int v = (x * 37 + y * 61 + g * 97 + 13) & 0xff;
+
+	switch (kind) {
+	case GLYPH_A1:
+		v = ((x + y + g) % 3 == 0) ? 0xff : 0;
+		argb[0] = argb[1] = argb[2] = argb[3] = v;
+		break;
+	case GLYPH_A8:
+		argb[0] = argb[1] = argb[2] = argb[3] = v;
+		break;
+	case GLYPH_ARGB32:
+		argb[0] = v;
+		argb[1] = v * ((g * 53 + x * 11) & 0xff) / 255;
+		argb[2] = v * ((g * 29 + y * 17) & 0xff) / 255;
+		argb[3] = v * ((g * 71 + x * y) & 0xff) / 255;
+		break;
+	}
+}
+
+static int
+glyph_stride(enum glyph_kind kind)
+{
+	switch (kind) {
+	case GLYPH_A1:
+		return (GLYPH_WIDTH + 31) / 32 * 4;
+	case GLYPH_A8:
+		return (GLYPH_WIDTH + 3) / 4 * 4;
+	case GLYPH_ARGB32:
+	default:
+		return GLYPH_WIDTH * 4;
+	}
+}
+
+/* Stores a 32-bit unit of glyph data in the server's byte order. */
+static void
+put_unit(Display *dpy, char *p, uint32_t v)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (ImageByteOrder(dpy) == LSBFirst)
+			p[i] = v >> (8 * i);
+		else
+			p[i] = v >> (8 * (3 - i));
+	}
+}
+
+/* Writes the image of glyph g the way the server expects it: rows padded to
+ * 32 bits, A1 bits in the server's bitmap bit order and 32-bit units in its
+ * byte order.
+ */
+static void
+make_glyph_image(Display *dpy, enum glyph_kind kind, unsigned int g,
+		 char *image)
+{
+	int stride = glyph_stride(kind);
+	uint8_t argb[4];
+	int x, y;
+
+	memset(image, 0, stride * GLYPH_HEIGHT);
+
+	for (y = 0; y < GLYPH_HEIGHT; y++) {
+		char *row = image + y * stride;
+
+		if (kind == GLYPH_A1) {
+			int unit;
+
+			for (unit = 0; unit < stride / 4; unit++) {
+				uint32_t bits = 0;
+
+				for (x = unit * 32;
+				     x < min(GLYPH_WIDTH, unit * 32 + 32); x++) {
+					glyph_pixel(kind, g, x, y, argb);
+					if (!argb[0])
+						continue;
+					if (BitmapBitOrder(dpy) == LSBFirst)
+						bits |= 1u << (x % 32);
+					else
+						bits |= 1u << (31 - x % 32);
+				}
+				put_unit(dpy, row + unit * 4, bits);
+			}
+			continue;
+		}
+
+		for (x = 0; x < GLYPH_WIDTH; x++) {
+			glyph_pixel(kind, g, x, y, argb);
+			if (kind == GLYPH_A8)
+				row[x] = argb[0];
+			else
+				put_unit(dpy, row + x * 4,
+					 (uint32_t)argb[0] << 24 |
+					 argb[1] << 16 | argb[2] << 8 |
+					 argb[3]);
+		}
+	}
+}
+
+/* Creates a glyphset of the given kind holding glyphs 0 to n - 1, each
+ * advancing the pen by its width.
+ */
+static GlyphSet
+create_glyphset(Display *dpy, enum glyph_kind kind, int n)
+{
+	int stride = glyph_stride(kind);
+	int size = stride * GLYPH_HEIGHT;
+	/* Keep each upload well under the core request size limit. */
+	int batch = max(1, 65536 / size);
+	XRenderPictFormat *format;
+	XGlyphInfo *info;
+	Glyph *gids;
+	char *images;
+	GlyphSet glyphset;
+	int i, j;
+
+	format = XRenderFindStandardFormat(dpy,
+	    glyph_kinds[kind].standard_format);
+	glyphset = XRenderCreateGlyphSet(dpy, format);
+
+	info = malloc(sizeof(*info) * batch);
+	gids = malloc(sizeof(*gids) * batch);
+	images = malloc((size_t)size * batch);
+	if (info == NULL || gids == NULL || images == NULL)
+		errx(1, "malloc error");
+
+	for (i = 0; i < n; i += batch) {
+		int count = min(batch, n - i);
+
+		for (j = 0; j < count; j++) {
+			gids[j] = i + j;
+			info[j].width = GLYPH_WIDTH;
+			info[j].height = GLYPH_HEIGHT;
+			info[j].x = 0;
+			info[j].y = 0;
+			info[j].xOff = GLYPH_WIDTH;
+			info[j].yOff = 0;
+			make_glyph_image(dpy, kind, i + j, images + j * size);
+		}
+		XRenderAddGlyphs(dpy, glyphset, gids, info, count, images,
+				 count * size);
+	}
+
+	free(info);
+	free(gids);
+	free(images);
+
+	return glyphset;
+}
+
+/* Draws a string of TEST_GLYPHS glyphs with no mask format, so that each glyph
+ * is composited on its own, and checks every pixel around and under it against
+ * do_composite() of the source through the glyph image.  ARGB32 glyphs are
+ * component-alpha masks.
+ */
+static bool
+glyphs_test(Display *dpy, enum glyph_kind kind, int op)
+{
+	XRenderPictFormat *argb32_format =
+	    XRenderFindStandardFormat(dpy, PictStandardARGB32);
+	XRenderPictureAttributes pa;
+	picture_info src, dst;
+	color4d src_color = {.5, .25, 0, .75};
+	color4d dst_color = {.25, .25, .5, .5};
+	unsigned int string[TEST_GLYPHS];
+	int w = TEST_X * 2 + TEST_GLYPHS * GLYPH_WIDTH;
+	int h = TEST_Y * 2 + GLYPH_HEIGHT;
+	bool ca = kind == GLYPH_ARGB32;
+	XRenderDirectFormat acc;
+	GlyphSet glyphset;
+	color4d *pixels;
+	XImage *image;
+	bool success = true;
+	int i, x, y;
+
+	pixels = malloc(sizeof(color4d) * w * h);
+	if (pixels == NULL)
+		errx(1, "malloc error");
+
+	src.format = argb32_format;
+	src.d = XCreatePixmap(dpy, DefaultRootWindow(dpy), 1, 1,
+			      argb32_format->depth);
+	pa.repeat = true;
+	src.pict = XRenderCreatePicture(dpy, src.d, argb32_format, CPRepeat,
+					&pa);
+	argb_fill(dpy, &src, 0, 0, 1, 1,
+		  src_color.a, src_color.r, src_color.g, src_color.b);
+
+	dst.format = argb32_format;
+	dst.d = XCreatePixmap(dpy, DefaultRootWindow(dpy), w, h,
+			      argb32_format->depth);
+	dst.pict = XRenderCreatePicture(dpy, dst.d, argb32_format, 0, NULL);
+	argb_fill(dpy, &dst, 0, 0, w, h,
+		  dst_color.a, dst_color.r, dst_color.g, dst_color.b);
+
+	glyphset = create_glyphset(dpy, kind, TEST_GLYPHS);
+	for (i = 0; i < TEST_GLYPHS; i++)
+		string[i] = i;
+
+	XRenderCompositeString32(dpy, op, src.pict, dst.pict, NULL, glyphset,
+				 0, 0, TEST_X, TEST_Y, string, TEST_GLYPHS);
+
+	image = get_image(dpy, &dst, 0, 0, w, h);
+	get_pixels_from_image(image, &dst, 0, 0, w, h, pixels);
+	release_image(image);
+
+	color_correct(&src, &src_color);
+	color_correct(&dst, &dst_color);
+	accuracy(&acc, &dst.format->direct, &src.format->direct);
+
+	for (y = 0; y < h && success; y++) {
+		for (x = 0; x < w; x++) {
+			color4d *tested = &pixels[y * w + x];
+			color4d expected = dst_color;
+			int gx = x - TEST_X, gy = y - TEST_Y;
+
+			if (gx >= 0 && gx < TEST_GLYPHS * GLYPH_WIDTH &&
+			    gy >= 0 && gy < GLYPH_HEIGHT) {
+				color4d mask;
+				uint8_t argb[4];
+
+				glyph_pixel(kind, gx / GLYPH_WIDTH,
+					    gx % GLYPH_WIDTH, gy, argb);
+				mask.a = argb[0] / 255.;
+				mask.r = argb[1] / 255.;
+				mask.g = argb[2] / 255.;
+				mask.b = argb[3] / 255.;
+
+				do_composite(op, &src_color, &mask, &dst_color,
+					     &expected, ca);
+				color_correct(&dst, &expected);
+			}
+
+			if (eval_diff(&acc, &expected, tested) > 3.) {
+				char testname[40];
+
+				snprintf(testname, sizeof(testname),
+					 "%s %s glyphs", ops[op].name,
+					 glyph_kinds[kind].name);
+				print_fail(testname, &expected, tested, x, y,
+					   eval_diff(&acc, &expected, tested));
+				success = false;
+				break;
+			}
+		}
+	}
+
+	XRenderFreeGlyphSet(dpy, glyphset);
+	XRenderFreePicture(dpy, src.pict);
+	XFreePixmap(dpy, src.d);
+	XRenderFreePicture(dpy, dst.pict);
+	XFreePixmap(dpy, dst.d);
+	free(pixels);
+
+	return success;
+}
+
+static struct rendercheck_test_result
+test_glyphs(Display *dpy)
+{
+	struct rendercheck_test_result result = {};
+	int kind;
+
+	for (kind = GLYPH_A1; kind <= GLYPH_ARGB32; kind++) {
+		printf("Beginning %s glyphs test\n", glyph_kinds[kind].name);
+
+		record_result(&result, glyphs_test(dpy, kind, PictOpSrc));
+		record_result(&result, glyphs_test(dpy, kind, PictOpOver));
+	}
+
+	return result;
+}
+
+DECLARE_RENDERCHECK_ARG_TEST(glyphs, "Glyphs", test_glyphs);
+
+/* Size of the glyph cache, and of the terminal-sized screen, used by the
+ * benchmark.
+ */
+#define CACHE_GLYPHS	4096
+#define SCREEN_COLUMNS	80
+#define SCREEN_LINES	25
+
+struct glyphs_bench {
+	Picture src, dst;
+	XRenderPictFormat *mask_format;
+	XGlyphElt32 *elts;
+	int num_elts;
+};
+
+static void
+glyphs_bench_func(Display *dpy, void *data, int iterations)
+{
+	struct glyphs_bench *b = data;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		XRenderCompositeText32(dpy, PictOpOver, b->src, b->dst,
+				       b->mask_format, 0, 0, 0, 0,
+				       b->elts, b->num_elts);
+	}
+}
+
+/* Lays out a screenful of glyphs picked at random from the cache.  With
+ * max_run of 1 or more, each line is broken into runs of 1 to max_run glyphs
+ * separated by a blank cell, like a terminal.  Otherwise each line is one run,
+ * like a document.  Returns the number of glyphs.
+ */
+static int
+layout_screen(struct glyphs_bench *b, GlyphSet glyphset, unsigned int *chars,
+	      int max_run)
+{
+	unsigned int seed = 1;
+	int line, col, n = 0;
+	int pen_x = 0, pen_y = 0;
+
+	b->num_elts = 0;
+	for (line = 0; line < SCREEN_LINES; line++) {
+		for (col = 0; col < SCREEN_COLUMNS;) {
+			XGlyphElt32 *elt = &b->elts[b->num_elts++];
+			int len = SCREEN_COLUMNS - col, i;
+
+			if (max_run > 0) {
+				seed = seed * 1103515245 + 12345;
+				len = min(len, 1 + (int)(seed >> 16) % max_run);
+			}
+
+			elt->glyphset = glyphset;
+			elt->chars = &chars[n];
+			elt->nchars = len;
+			elt->xOff = col * GLYPH_WIDTH - pen_x;
+			elt->yOff = line * GLYPH_HEIGHT - pen_y;
+			for (i = 0; i < len; i++) {
+				seed = seed * 1103515245 + 12345;
+				chars[n++] = (seed >> 8) % CACHE_GLYPHS;
+			}
+
+			pen_x = (col + len) * GLYPH_WIDTH;
+			pen_y = line * GLYPH_HEIGHT;
+			col += len + (max_run > 0);
+		}
+	}
+
+	return n;
+}
+
+/* Times drawing screens of text from a cache of CACHE_GLYPHS glyphs of each
+ * kind, as many short runs and as whole lines, reporting glyphs/s.
+ */
+static void
+bench_glyphs(Display *dpy)
+{
+	XRenderPictFormat *argb32_format =
+	    XRenderFindStandardFormat(dpy, PictStandardARGB32);
+	int num_chars = SCREEN_COLUMNS * SCREEN_LINES;
+	struct glyphs_bench b;
+	struct bench_desc desc;
+	XRenderColor black = { 0, 0, 0, 0xffff };
+	unsigned int *chars;
+	Pixmap dst_pix;
+	char name[80];
+	int kind;
+
+	chars = malloc(sizeof(*chars) * num_chars);
+	b.elts = malloc(sizeof(*b.elts) * num_chars);
+	if (chars == NULL || b.elts == NULL)
+		errx(1, "malloc error");
+
+	dst_pix = XCreatePixmap(dpy, DefaultRootWindow(dpy),
+				SCREEN_COLUMNS * GLYPH_WIDTH,
+				SCREEN_LINES * GLYPH_HEIGHT,
+				argb32_format->depth);
+	b.dst = XRenderCreatePicture(dpy, dst_pix, argb32_format, 0, NULL);
+	b.src = XRenderCreateSolidFill(dpy, &black);
+
+	desc.name = name;
+	desc.func = glyphs_bench_func;
+	desc.data = &b;
+	desc.iterations = bench_iterations;
+	desc.unit_name = "glyphs";
+
+	for (kind = GLYPH_A1; kind <= GLYPH_ARGB32; kind++) {
+		GlyphSet glyphset = create_glyphset(dpy, kind, CACHE_GLYPHS);
+
+		/* Component-alpha glyphs are drawn one by one, the others
+		 * through a mask of their own format, as toolkits do.
+		 */
+		b.mask_format = kind == GLYPH_ARGB32 ? NULL :
+		    XRenderFindStandardFormat(dpy,
+			glyph_kinds[kind].standard_format);
+
+		desc.units = layout_screen(&b, glyphset, chars, 8);
+		desc.pixels = desc.units * GLYPH_WIDTH * GLYPH_HEIGHT;
+		snprintf(name, sizeof(name), "%s terminal %d runs",
+			 glyph_kinds[kind].name, b.num_elts);
+		run_benchmark(dpy, &desc);
+
+		desc.units = layout_screen(&b, glyphset, chars, 0);
+		desc.pixels = desc.units * GLYPH_WIDTH * GLYPH_HEIGHT;
+		snprintf(name, sizeof(name), "%s document %d runs",
+			 glyph_kinds[kind].name, b.num_elts);
+		run_benchmark(dpy, &desc);
+
+		XRenderFreeGlyphSet(dpy, glyphset);
+	}
+
+	XRenderFreePicture(dpy, b.src);
+	XRenderFreePicture(dpy, b.dst);
+	XFreePixmap(dpy, dst_pix);
+	free(chars);
+	free(b.elts);
+}
+
+DECLARE_RENDERCHECK_ARG_BENCH(glyphs, "glyph rendering", bench_glyphs);
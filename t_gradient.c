@@ -21,6 +21,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "rendercheck.h"
 
@@ -250,11 +251,29 @@ static void calculate_linear_gradient_color(int x, int y,
 bool linear_gradient_test(Display *dpy, picture_info *win,
                           picture_info *dst, int op, picture_info *dst_color)
 {
-    color4d expected, tested, tdst, tgradient;
+    color4d expected, tdst, tgradient, *pixels;
+    XRenderDirectFormat acc;
     int i, s, p, repeat;
+    int read_width = 0, read_height = 0;
     Picture gradient;
     char testname[40];
     bool success = true;
+    const pixel *pix;
+
+    /* All of the test pixels are read back with a single image covering
+     * them, rather than a round trip per pixel.
+     */
+    for (pix = test_pixels; pix->x >= 0; pix++) {
+        read_width = max(read_width, pix->x + 1);
+        read_height = max(read_height, pix->y + 1);
+    }
+    pixels = malloc(sizeof(color4d) * read_width * read_height);
+    if (pixels == NULL)
+        errx(1, "malloc error");
+
+    tdst = dst_color->color;
+    color_correct(dst, &tdst);
+    accuracy(&acc, &dst->format->direct, &dst_color->format->direct);
 
     for (s = 0; s < n_stop_list; ++s) {
         for (p = 0; p < n_linear_gradient_points; p += 2) {
@@ -278,8 +297,8 @@ bool linear_gradient_test(Display *dpy, picture_info *win,
             gradient = XRenderCreateLinearGradient(dpy, &g, stops, colors, i);
 
             for (repeat = 1; repeat < 4; ++repeat) {
-                const pixel *pix;
                 XRenderPictureAttributes pa;
+                XImage *image;
 		pa.repeat = repeat;
 		XRenderChangePicture(dpy, gradient, CPRepeat, &pa);
 
@@ -289,29 +308,28 @@ bool linear_gradient_test(Display *dpy, picture_info *win,
                 XRenderComposite(dpy, ops[op].op, gradient, 0,
                                  dst->pict, 0, 0, 0, 0, 0, 0, win_width, win_height);
 
+		image = get_image(dpy, dst, 0, 0, read_width, read_height);
 		copy_pict_to_win(dpy, dst, win, win_width, win_height);
+		get_pixels_from_image(image, dst, 0, 0, read_width, read_height,
+				      pixels);
+		release_image(image);
 
                 pix = test_pixels;
                 while (pix->x >= 0) {
-                    XRenderDirectFormat acc;
-                    get_pixel(dpy, dst, pix->x, pix->y, &tested);
+                    color4d *tested = &pixels[pix->y * read_width + pix->x];
 
                     calculate_linear_gradient_color(pix->x, pix->y, &linear_gradient_points[p],
                                                     stps, &tgradient, repeat);
 
-                    tdst = dst_color->color;
-                    color_correct(dst, &tdst);
                     do_composite(ops[op].op, &tgradient, NULL, &tdst,
                                  &expected, False);
                     color_correct(dst, &expected);
 
-                    accuracy(&acc, &dst->format->direct, &dst_color->format->direct);
-
-                    if (eval_diff(&acc, &expected, &tested) > 3.) {
+                    if (eval_diff(&acc, &expected, tested) > 3.) {
 			snprintf(testname, 40,
 				 "%s linear gradient", ops[op].name);
-			print_fail(testname, &expected, &tested, 0, 0,
-				   eval_diff(&dst->format->direct, &expected, &tested));
+			print_fail(testname, &expected, tested, 0, 0,
+				   eval_diff(&dst->format->direct, &expected, tested));
                         printf("gradient: %d stops: %d repeat: %d pos: %d/%d\n"
                                "src color: %.2f %.2f %.2f %.2f\n"
                                "dst color: %.2f %.2f %.2f %.2f\n",
@@ -331,7 +349,189 @@ bool linear_gradient_test(Display *dpy, picture_info *win,
             XRenderFreePicture(dpy, gradient);
         }
     }
+    free(pixels);
     return success;
 }
 
 
+
+/* Size of the destination the gradient benchmark fills. */
+#define GRADIENT_BENCH_SIZE	512
+
+enum gradient_kind {
+    GRADIENT_LINEAR,
+    GRADIENT_RADIAL,
+    GRADIENT_CONICAL,
+};
+
+static const char *gradient_names[] = {
+    [GRADIENT_LINEAR] = "linear",
+    [GRADIENT_RADIAL] = "radial",
+    [GRADIENT_CONICAL] = "conical",
+};
+
+static const char *repeat_names[] = {
+    [RepeatNormal] = "normal",
+    [RepeatPad] = "pad",
+    [RepeatReflect] = "reflect",
+};
+
+struct gradient_bench {
+    int op;
+    Picture gradient;
+    const picture_info *dst;
+};
+
+static void
+gradient_bench_func(Display *dpy, void *data, int iterations)
+{
+    struct gradient_bench *b = data;
+    int i;
+
+    for (i = 0; i < iterations; i++) {
+        XRenderComposite(dpy, b->op, b->gradient, 0, b->dst->pict,
+                         0, 0, 0, 0, 0, 0,
+                         GRADIENT_BENCH_SIZE, GRADIENT_BENCH_SIZE);
+    }
+}
+
+/* Creates a gradient of the given kind with n evenly spaced stops cycling
+ * through blue, green and red, every other one translucent.  Its geometry
+ * repeats a few times across the benchmark destination.
+ */
+static Picture
+create_bench_gradient(Display *dpy, enum gradient_kind kind, int n, int repeat)
+{
+    XFixed *stops = malloc(sizeof(XFixed) * n);
+    XRenderColor *stop_colors = malloc(sizeof(XRenderColor) * n);
+    XRenderPictureAttributes pa;
+    Picture gradient = None;
+    XFixed center = XDoubleToFixed(GRADIENT_BENCH_SIZE / 2);
+    XFixed period = XDoubleToFixed(GRADIENT_BENCH_SIZE / 4);
+    int i;
+
+    if (stops == NULL || stop_colors == NULL)
+        errx(1, "malloc error");
+
+    for (i = 0; i < n; i++) {
+        stops[i] = XDoubleToFixed((double)i / (n - 1));
+        stop_colors[i].red = (i % 3 == 2) ? 65535 : 0;
+        stop_colors[i].green = (i % 3 == 1) ? 65535 : 0;
+        stop_colors[i].blue = (i % 3 == 0) ? 65535 : 0;
+        stop_colors[i].alpha = (i % 2) ? 32768 : 65535;
+    }
+
+    switch (kind) {
+    case GRADIENT_LINEAR: {
+        XLinearGradient g;
+
+        g.p1.x = 0;
+        g.p1.y = 0;
+        g.p2.x = period;
+        g.p2.y = period;
+        gradient = XRenderCreateLinearGradient(dpy, &g, stops, stop_colors,
+                                               n);
+        break;
+    }
+    case GRADIENT_RADIAL: {
+        XRadialGradient g;
+
+        g.inner.x = center;
+        g.inner.y = center;
+        g.inner.radius = 0;
+        g.outer.x = center;
+        g.outer.y = center;
+        g.outer.radius = period;
+        gradient = XRenderCreateRadialGradient(dpy, &g, stops, stop_colors,
+                                               n);
+        break;
+    }
+    case GRADIENT_CONICAL: {
+        XConicalGradient g;
+
+        g.center.x = center;
+        g.center.y = center;
+        g.angle = 0;
+        gradient = XRenderCreateConicalGradient(dpy, &g, stops,
+                                                stop_colors, n);
+        break;
+    }
+    }
+
+    pa.repeat = repeat;
+    XRenderChangePicture(dpy, gradient, CPRepeat, &pa);
+
+    free(stops);
+    free(stop_colors);
+    return gradient;
+}
+
+/* Times each op compositing linear, radial and conical gradients with 2 to
+ * 256 stops, in each repeat mode, onto a large destination of the given
+ * format, reporting Mpixels/s.
+ */
+void
+gradient_bench(Display *dpy, XRenderPictFormat *dst_format,
+               const int *op, int num_op)
+{
+    static const int stop_counts[] = { 2, 4, 16, 64, 256 };
+    struct gradient_bench b;
+    struct bench_desc desc;
+    picture_info dst;
+    char name[80], *dst_name;
+    unsigned int s;
+    int i, kind, repeat;
+
+    dst.format = dst_format;
+    dst.d = XCreatePixmap(dpy, DefaultRootWindow(dpy), GRADIENT_BENCH_SIZE,
+                          GRADIENT_BENCH_SIZE, dst_format->depth);
+    dst.pict = XRenderCreatePicture(dpy, dst.d, dst_format, 0, NULL);
+    describe_format(&dst_name, NULL, dst_format);
+
+    b.dst = &dst;
+
+    desc.name = name;
+    desc.func = gradient_bench_func;
+    desc.data = &b;
+    desc.units = 1;
+    desc.unit_name = "composites";
+    desc.pixels = GRADIENT_BENCH_SIZE * GRADIENT_BENCH_SIZE;
+    desc.iterations = max(1, min(bench_iterations,
+                                 (1 << 22) / (int)desc.pixels));
+
+    for (kind = GRADIENT_LINEAR; kind <= GRADIENT_CONICAL; kind++) {
+        for (s = 0; s < ARRAY_SIZE(stop_counts); s++) {
+            for (repeat = 1; repeat < 4; ++repeat) {
+                /* Conical gradients go all the way round whatever the
+                 * repeat mode, so there's only the one to time.
+                 */
+                if (kind == GRADIENT_CONICAL && repeat > 1)
+                    break;
+
+                b.gradient = create_bench_gradient(dpy, kind, stop_counts[s],
+                                                   repeat);
+
+                for (i = 0; i < num_op; i++) {
+                    b.op = ops[op[i]].op;
+                    if (kind == GRADIENT_CONICAL) {
+                        snprintf(name, sizeof(name), "%s %s %d stops -> %s",
+                                 ops[op[i]].name, gradient_names[kind],
+                                 stop_counts[s], dst_name);
+                    } else {
+                        snprintf(name, sizeof(name),
+                                 "%s %s %d stops %s -> %s", ops[op[i]].name,
+                                 gradient_names[kind], stop_counts[s],
+                                 repeat_names[repeat], dst_name);
+                    }
+                    run_benchmark(dpy, &desc);
+                }
+
+                XRenderFreePicture(dpy, b.gradient);
+            }
+        }
+    }
+
+    free(dst_name);
+    XRenderFreePicture(dpy, dst.pict);
+    XFreePixmap(dpy, dst.d);
+}
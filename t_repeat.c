@@ -61,6 +61,7 @@ repeat_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 		int x, y, i;
 		char name[40];
 		color4d tdst, c1expected, c2expected;
+		color4d pixels[TEST_HEIGHT][TEST_WIDTH];
 		XRenderPictureAttributes pa;
 		XRenderDirectFormat acc;
 		XImage *image;
@@ -130,29 +131,29 @@ repeat_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 		color_correct(dst, &c1expected);
 		color_correct(dst, &c2expected);
 
-		image = XGetImage(dpy, dst->d,
-				  0, 0, TEST_WIDTH, TEST_HEIGHT,
-				  ~0U, ZPixmap);
+		image = get_image(dpy, dst, 0, 0, TEST_WIDTH, TEST_HEIGHT);
+		get_pixels_from_image(image, dst, 0, 0, TEST_WIDTH, TEST_HEIGHT,
+				      &pixels[0][0]);
+		release_image(image);
 
 		for (y = 0; y < TEST_HEIGHT; y++) {
 		    for (x = 0; x < TEST_WIDTH; x++) {
 			int samplex = x % w;
 			int sampley = y % h;
-			color4d *expected, tested;
+			color4d *expected, *tested = &pixels[y][x];
 
 			if (samplex < c2w && sampley < c2h) {
 				expected = &c2expected;
 			} else {
 				expected = &c1expected;
 			}
-			get_pixel_from_image(image, dst, x, y, &tested);
 
-			if (eval_diff(&acc, expected, &tested) > 3.) {
+			if (eval_diff(&acc, expected, tested) > 3.) {
 			    snprintf(name, 40, "%dx%d %s %s-repeat", w, h,
 				     ops[op].name, test_mask ? "mask" : "src");
 
-			    print_fail(name, expected, &tested, x, y,
-				       eval_diff(&acc, expected, &tested));
+			    print_fail(name, expected, tested, x, y,
+				       eval_diff(&acc, expected, tested));
 
 			    failed = true;
 			    goto out;
@@ -160,7 +161,6 @@ repeat_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 		    }
 		}
 out:
-		XDestroyImage(image);
 		XRenderFreePicture(dpy, src.pict);
 		XFreePixmap(dpy, src.d);
 
@@ -170,3 +170,105 @@ out:
 	}
 	return true;
 }
+
+/* Size of the destination the repeat benchmark tiles. */
+#define REPEAT_BENCH_SIZE 1024
+
+static const char *repeat_bench_names[] = {
+	[RepeatNormal] = "normal",
+	[RepeatPad] = "pad",
+	[RepeatReflect] = "reflect",
+};
+
+struct repeat_bench {
+	int op;
+	Picture tile, dst;
+};
+
+static void
+repeat_bench_func(Display *dpy, void *data, int iterations)
+{
+	struct repeat_bench *b = data;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		XRenderComposite(dpy, b->op, b->tile, None, b->dst,
+				 0, 0, 0, 0, 0, 0,
+				 REPEAT_BENCH_SIZE, REPEAT_BENCH_SIZE);
+	}
+}
+
+/* Times each op tiling the repeat_test() tiles, all created up front, over a
+ * large destination of the given format with each repeat mode, reporting
+ * Mpixels/s for each tile size.
+ */
+void
+repeat_bench(Display *dpy, XRenderPictFormat *dst_format, const int *op,
+    int num_op, picture_info *c1, picture_info *c2)
+{
+	XRenderPictFormat *argb32_format =
+	    XRenderFindStandardFormat(dpy, PictStandardARGB32);
+	Picture tiles[ARRAY_SIZE(sizes)];
+	Pixmap tile_pixmaps[ARRAY_SIZE(sizes)];
+	struct repeat_bench b;
+	struct bench_desc desc;
+	Pixmap dst_pix;
+	char name[80], *dst_name;
+	unsigned int t;
+	int i, repeat;
+
+	for (t = 0; t < ARRAY_SIZE(sizes); t++) {
+		int size = sizes[t];
+
+		tile_pixmaps[t] = XCreatePixmap(dpy, DefaultRootWindow(dpy),
+		    size, size, argb32_format->depth);
+		tiles[t] = XRenderCreatePicture(dpy, tile_pixmaps[t],
+		    argb32_format, 0, NULL);
+		XRenderComposite(dpy, PictOpSrc, c1->pict, None, tiles[t],
+				 0, 0, 0, 0, 0, 0, size, size);
+		XRenderComposite(dpy, PictOpSrc, c2->pict, None, tiles[t],
+				 0, 0, 0, 0, 0, 0, size / 2, size / 2);
+	}
+
+	dst_pix = XCreatePixmap(dpy, DefaultRootWindow(dpy), REPEAT_BENCH_SIZE,
+	    REPEAT_BENCH_SIZE, dst_format->depth);
+	b.dst = XRenderCreatePicture(dpy, dst_pix, dst_format, 0, NULL);
+	describe_format(&dst_name, NULL, dst_format);
+
+	desc.name = name;
+	desc.func = repeat_bench_func;
+	desc.data = &b;
+	desc.units = 1;
+	desc.unit_name = "composites";
+	desc.pixels = REPEAT_BENCH_SIZE * REPEAT_BENCH_SIZE;
+	desc.iterations = max(1, min(bench_iterations,
+	    (1 << 24) / (int)desc.pixels));
+
+	for (repeat = RepeatNormal; repeat <= RepeatReflect; repeat++) {
+		XRenderPictureAttributes pa;
+
+		pa.repeat = repeat;
+		for (t = 0; t < ARRAY_SIZE(sizes); t++)
+			XRenderChangePicture(dpy, tiles[t], CPRepeat, &pa);
+
+		for (i = 0; i < num_op; i++) {
+			b.op = ops[op[i]].op;
+			for (t = 0; t < ARRAY_SIZE(sizes); t++) {
+				b.tile = tiles[t];
+				snprintf(name, sizeof(name),
+				    "%s %dx%d %s tile -> %s", ops[op[i]].name,
+				    sizes[t], sizes[t],
+				    repeat_bench_names[repeat], dst_name);
+				run_benchmark(dpy, &desc);
+			}
+		}
+	}
+
+	for (t = 0; t < ARRAY_SIZE(sizes); t++) {
+		XRenderFreePicture(dpy, tiles[t]);
+		XFreePixmap(dpy, tile_pixmaps[t]);
+	}
+	free(dst_name);
+	XRenderFreePicture(dpy, b.dst);
+	XFreePixmap(dpy, dst_pix);
+}
@@ -22,57 +22,10 @@
  */
 
 #include <inttypes.h>
-#include <sys/ipc.h>
+#include <string.h>
 #include <sys/shm.h>
+#include <X11/Xlib-xcb.h>
 #include "rendercheck.h"
-#include <X11/extensions/XShm.h>
-
-bool had_x_error;
-static int (*orig_x_error_handler)(Display *, XErrorEvent *);
-
-static int
-shmerrorhandler(Display *d, XErrorEvent *e)
-{
-	had_x_error = true;
-	if (e->error_code == BadAccess) {
-		fprintf(stderr,"failed to attach shared memory\n");
-		return 0;
-	} else {
-		return (*orig_x_error_handler)(d,e);
-	}
-}
-
-static XShmSegmentInfo *
-get_x_shm_info(Display *dpy, size_t size)
-{
-	XShmSegmentInfo *shm_info = calloc(1, sizeof(*shm_info));
-
-	if (!XShmQueryExtension(dpy))
-		return NULL;
-
-	shm_info->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT|0777);
-	if (shm_info->shmid < 0) {
-		free(shm_info);
-		return NULL;
-	}
-
-	shm_info->shmaddr = shmat(shm_info->shmid, NULL, 0);
-	if (shm_info->shmaddr == (void *)-1) {
-		free(shm_info);
-		return NULL;
-	}
-
-	shm_info->readOnly = false;
-
-	XSync(dpy, true);
-	had_x_error = false;
-	orig_x_error_handler = XSetErrorHandler(shmerrorhandler);
-	XShmAttach(dpy, shm_info);
-	XSync(dpy, true);
-	XSetErrorHandler(orig_x_error_handler);
-
-	return shm_info;
-}
 
 static void
 fill_shm_with_formatted_color(Display *dpy, XShmSegmentInfo *shm_info,
@@ -113,8 +66,13 @@ test_format(Display *dpy, int op, int w, int h, struct render_format *format)
 	bool pass = true;
 	size_t size = w * h * 4;
 	color4d dst_color = {.25, .25, .25, .25};
+	color4d *pixels;
 	picture_info src, dst;
 
+	pixels = malloc(sizeof(color4d) * w * h);
+	if (pixels == NULL)
+		errx(1, "malloc error");
+
 	shm_info = get_x_shm_info(dpy, size);
 	if (!shm_info) {
 		pass = false;
@@ -133,6 +91,7 @@ test_format(Display *dpy, int op, int w, int h, struct render_format *format)
 	argb32_format = XRenderFindStandardFormat(dpy, PictStandardARGB32);
 	dst_pix = XCreatePixmap(dpy, DefaultRootWindow(dpy), w, h,
 				argb32_format->depth);
+	dst.d = dst_pix;
 	dst.pict = XRenderCreatePicture(dpy, dst_pix, argb32_format, 0, NULL);
 	dst.format = XRenderFindStandardFormat(dpy, PictStandardARGB32);
 
@@ -156,9 +115,9 @@ test_format(Display *dpy, int op, int w, int h, struct render_format *format)
 				 0, 0,
 				 w, h);
 
-		image = XGetImage(dpy, dst_pix,
-				  0, 0, w, h,
-				  0xffffffff, ZPixmap);
+		image = get_image(dpy, &dst, 0, 0, w, h);
+		get_pixels_from_image(image, &dst, 0, 0, w, h, pixels);
+		release_image(image);
 
 		color_correct(&src, &src_color);
 
@@ -171,11 +130,9 @@ test_format(Display *dpy, int op, int w, int h, struct render_format *format)
 		for (int j = 0; j < w * h; j++) {
 			int x = j % w;
 			int y = j / h;
-			color4d tested;
+			color4d *tested = &pixels[y * w + x];
 
-			get_pixel_from_image(image, &dst, x, y, &tested);
-
-			if (eval_diff(&acc, &expected, &tested) > 3.) {
+			if (eval_diff(&acc, &expected, tested) > 3.) {
 				char testname[30];
 
 				pass = false;
@@ -184,8 +141,8 @@ test_format(Display *dpy, int op, int w, int h, struct render_format *format)
 					 "%s %s SHM blend", ops[op].name,
 					format->name);
 
-				print_fail(testname, &expected, &tested, x, y,
-					   eval_diff(&acc, &expected, &tested));
+				print_fail(testname, &expected, tested, x, y,
+					   eval_diff(&acc, &expected, tested));
 				printf("src color: %.2f %.2f %.2f %.2f\n",
 				       src_color.r,
 				       src_color.g,
@@ -200,8 +157,6 @@ test_format(Display *dpy, int op, int w, int h, struct render_format *format)
 				break;
 			}
 		}
-
-		XDestroyImage(image);
 	}
 
 	XRenderFreePicture(dpy, src.pict);
@@ -210,13 +165,9 @@ test_format(Display *dpy, int op, int w, int h, struct render_format *format)
 fail:
 	if (shm_info) {
 		XFreePixmap(dpy, src_pix);
-		XShmDetach(dpy, shm_info);
-		/* Wait for server to fully detach before removing. */
-		XSync(dpy, False);
-		shmdt(shm_info->shmaddr);
-		shmctl(shm_info->shmid, IPC_RMID, NULL);
-		free(shm_info);
+		free_x_shm_info(dpy, shm_info);
 	}
+	free(pixels);
 
 	return pass;
 }
@@ -243,3 +194,239 @@ test_shmblend(Display *dpy)
 
 DECLARE_RENDERCHECK_ARG_TEST(shmblend, "SHM Pixmap blending",
 			     test_shmblend);
+
+enum upload_path {
+	UPLOAD_PUT_IMAGE,
+	UPLOAD_SHM_PUT_IMAGE,
+	UPLOAD_SHM_PIXMAP,
+};
+
+static const char *upload_names[] = {
+	[UPLOAD_PUT_IMAGE] = "XPutImage",
+	[UPLOAD_SHM_PUT_IMAGE] = "XShmPutImage",
+	[UPLOAD_SHM_PIXMAP] = "SHM pixmap",
+};
+
+/* One of the segments frames are written into.  The fence is a round trip
+ * sent after the frame's last use of the segment, which must be waited for
+ * before writing the segment again.
+ */
+struct upload_segment {
+	XShmSegmentInfo *shm_info;
+	XImage *image;
+	Pixmap pixmap;
+	Picture pict;
+	xcb_get_input_focus_cookie_t fence;
+	bool fenced;
+};
+
+struct upload_bench {
+	enum upload_path path;
+	int num_buffers;
+	int w, h;
+	size_t size;
+	Pixmap staging;
+	Picture staging_pict;
+	GC gc;
+	XImage *image;
+	Picture dst;
+	struct upload_segment segments[2];
+	int frame;
+};
+
+static void
+wait_for_fence(xcb_connection_t *c, struct upload_segment *seg)
+{
+	if (seg->fenced) {
+		free(xcb_get_input_focus_reply(c, seg->fence, NULL));
+		seg->fenced = false;
+	}
+}
+
+/* Each iteration writes a frame and gets it composited to the destination.
+ * With one buffer, the next frame waits for the server to be done with this
+ * one.  With two, the client writes one segment while the server reads the
+ * other, like a video player.
+ */
+static void
+upload_bench_func(Display *dpy, void *data, int iterations)
+{
+	struct upload_bench *b = data;
+	xcb_connection_t *c = XGetXCBConnection(dpy);
+	int i;
+
+	for (i = 0; i < iterations; i++, b->frame++) {
+		struct upload_segment *seg =
+		    &b->segments[b->frame % b->num_buffers];
+		Picture src = b->staging_pict;
+
+		if (b->path == UPLOAD_PUT_IMAGE) {
+			memset(b->image->data, b->frame, b->size);
+			XPutImage(dpy, b->staging, b->gc, b->image,
+				  0, 0, 0, 0, b->w, b->h);
+		} else {
+			wait_for_fence(c, seg);
+			memset(seg->shm_info->shmaddr, b->frame, b->size);
+			if (b->path == UPLOAD_SHM_PUT_IMAGE) {
+				XShmPutImage(dpy, b->staging, b->gc,
+					     seg->image, 0, 0, 0, 0,
+					     b->w, b->h, False);
+			} else {
+				src = seg->pict;
+			}
+		}
+
+		XRenderComposite(dpy, PictOpSrc, src, 0, b->dst,
+				 0, 0, 0, 0, 0, 0, b->w, b->h);
+
+		if (b->path != UPLOAD_PUT_IMAGE) {
+			trace_get_input_focus(dpy);
+			seg->fence = xcb_get_input_focus(c);
+			seg->fenced = true;
+		}
+	}
+}
+
+static bool
+setup_upload_segment(Display *dpy, struct upload_bench *b,
+		     struct upload_segment *seg, XRenderPictFormat *format)
+{
+	seg->shm_info = get_x_shm_info(dpy, b->size);
+	if (seg->shm_info == NULL)
+		return false;
+
+	seg->image = XShmCreateImage(dpy, NULL, format->depth, ZPixmap,
+				     seg->shm_info->shmaddr, seg->shm_info,
+				     b->w, b->h);
+	if (b->path == UPLOAD_SHM_PIXMAP) {
+		seg->pixmap = XShmCreatePixmap(dpy, DefaultRootWindow(dpy),
+					       seg->shm_info->shmaddr,
+					       seg->shm_info, b->w, b->h,
+					       format->depth);
+		seg->pict = XRenderCreatePicture(dpy, seg->pixmap, format, 0,
+						 NULL);
+	}
+	seg->fenced = false;
+
+	return true;
+}
+
+static void
+free_upload_segment(Display *dpy, struct upload_segment *seg)
+{
+	wait_for_fence(XGetXCBConnection(dpy), seg);
+	if (seg->pict)
+		XRenderFreePicture(dpy, seg->pict);
+	if (seg->pixmap)
+		XFreePixmap(dpy, seg->pixmap);
+	if (seg->image)
+		XDestroyImage(seg->image);
+	if (seg->shm_info)
+		free_x_shm_info(dpy, seg->shm_info);
+	memset(seg, 0, sizeof(*seg));
+}
+
+/* Times uploading w x h frames of the given format through one path and
+ * compositing them to an a8r8g8b8 picture, reporting GB/s and the time per
+ * frame.
+ */
+static void
+bench_upload(Display *dpy, enum upload_path path, int num_buffers,
+	     int w, int h, struct render_format *format)
+{
+	XRenderPictFormat *argb32_format =
+	    XRenderFindStandardFormat(dpy, PictStandardARGB32);
+	struct upload_bench b;
+	struct bench_desc desc;
+	Pixmap dst_pix;
+	char name[80];
+	int i;
+
+	memset(&b, 0, sizeof(b));
+	b.path = path;
+	b.num_buffers = num_buffers;
+	b.w = w;
+	b.h = h;
+
+	b.staging = XCreatePixmap(dpy, DefaultRootWindow(dpy), w, h,
+				  format->format->depth);
+	b.staging_pict = XRenderCreatePicture(dpy, b.staging, format->format,
+					      0, NULL);
+	b.gc = XCreateGC(dpy, b.staging, 0, NULL);
+	dst_pix = XCreatePixmap(dpy, DefaultRootWindow(dpy), w, h,
+				argb32_format->depth);
+	b.dst = XRenderCreatePicture(dpy, dst_pix, argb32_format, 0, NULL);
+
+	b.image = XCreateImage(dpy, NULL, format->format->depth, ZPixmap, 0,
+			       NULL, w, h, 32, 0);
+	b.size = (size_t)b.image->bytes_per_line * h;
+	b.image->data = malloc(b.size);
+	if (b.image->data == NULL)
+		errx(1, "malloc error");
+
+	for (i = 0; i < num_buffers && path != UPLOAD_PUT_IMAGE; i++) {
+		if (!setup_upload_segment(dpy, &b, &b.segments[i],
+					  format->format)) {
+			printf("%s %s %dx%d: MIT-SHM unavailable\n",
+			       upload_names[path], format->name, w, h);
+			goto done;
+		}
+	}
+
+	snprintf(name, sizeof(name), "%s%s %s %dx%d", upload_names[path],
+		 num_buffers > 1 ? " double-buffered" : "",
+		 format->name, w, h);
+	desc.name = name;
+	desc.func = upload_bench_func;
+	desc.data = &b;
+	desc.iterations = max(2, min(bench_iterations,
+				     (1 << 26) / (int)b.size));
+	desc.units = b.size / 1e9;
+	desc.unit_name = "GB";
+	desc.pixels = w * h;
+	run_benchmark(dpy, &desc);
+
+done:
+	for (i = 0; i < num_buffers; i++)
+		free_upload_segment(dpy, &b.segments[i]);
+	XDestroyImage(b.image);
+	XFreeGC(dpy, b.gc);
+	XRenderFreePicture(dpy, b.staging_pict);
+	XFreePixmap(dpy, b.staging);
+	XRenderFreePicture(dpy, b.dst);
+	XFreePixmap(dpy, dst_pix);
+}
+
+static void
+bench_shmupload(Display *dpy)
+{
+	static const int sizes[] = { 64, 256, 1024 };
+	int major, minor, i, path;
+	unsigned int s;
+	Bool shm_pixmaps = False;
+
+	if (XShmQueryExtension(dpy))
+		XShmQueryVersion(dpy, &major, &minor, &shm_pixmaps);
+	if (shm_pixmaps && XShmPixmapFormat(dpy) != ZPixmap)
+		shm_pixmaps = False;
+
+	for (i = 0; i < nformats; i++) {
+		for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+			for (path = UPLOAD_PUT_IMAGE; path <= UPLOAD_SHM_PIXMAP;
+			     path++) {
+				if (path == UPLOAD_SHM_PIXMAP && !shm_pixmaps)
+					continue;
+
+				bench_upload(dpy, path, 1, sizes[s], sizes[s],
+					     &formats[i]);
+				if (path != UPLOAD_PUT_IMAGE) {
+					bench_upload(dpy, path, 2, sizes[s],
+						     sizes[s], &formats[i]);
+				}
+			}
+		}
+	}
+}
+
+DECLARE_RENDERCHECK_ARG_BENCH(shmupload, "SHM upload bandwidth",
+			      bench_shmupload);
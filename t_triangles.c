@@ -26,6 +26,8 @@
  */
 
 #include <stdio.h>
+#include <math.h>
+#include <X11/extensions/renderproto.h>
 
 #include "rendercheck.h"
 
@@ -75,6 +77,7 @@ triangles_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 	int x, y;
 	bool success = true;
 	XImage *image;
+	color4d pixels[5][5];
 
 	triangles[0].p1.x = XDoubleToFixed(2);
 	triangles[0].p1.y = XDoubleToFixed(2);
@@ -107,13 +110,13 @@ triangles_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 	do_composite(ops[op].op, &src_color->color, NULL, &dst_color->color, &tsrc, false);
 	color_correct(dst, &tsrc);
 
-	image = XGetImage(dpy, dst->d,
-			  0, 0, 5, 5,
-			  0xffffffff, ZPixmap);
+	image = get_image(dpy, dst, 0, 0, 5, 5);
+	get_pixels_from_image(image, dst, 0, 0, 5, 5, &pixels[0][0]);
+	release_image(image);
 
 	for (x = 0; x < 5; x++) {
 	    for (y = 0; y < 5; y++) {
-		color4d expected, tested;
+		color4d expected, *tested = &pixels[y][x];
 
 		if (x >= 2 && x < 4 && y >= 2 && y < 4) {
 			expected = tsrc;
@@ -121,11 +124,9 @@ triangles_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 			expected = tdst;
 		}
 
-		get_pixel_from_image(image, dst, x, y, &tested);
-
-		if (eval_diff(&dst->format->direct, &expected, &tested) > 2.) {
-		    print_fail("triangles", &expected, &tested, x, y,
-			       eval_diff(&dst->format->direct, &expected, &tested));
+		if (eval_diff(&dst->format->direct, &expected, tested) > 2.) {
+		    print_fail("triangles", &expected, tested, x, y,
+			       eval_diff(&dst->format->direct, &expected, tested));
 		    success = false;
 		}
 	    }
@@ -138,7 +139,6 @@ triangles_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 		    dst_color->color.r, dst_color->color.g,
 		    dst_color->color.b, dst_color->color.a);
 	}
-	XDestroyImage(image);
 
 	return success;
 }
@@ -152,6 +152,7 @@ trifan_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 	int x, y;
 	bool success = true;
 	XImage *image;
+	color4d pixels[5][5];
 
 	points[0].x = XDoubleToFixed(2);
 	points[0].y = XDoubleToFixed(2);
@@ -179,13 +180,13 @@ trifan_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 	do_composite(ops[op].op, &src_color->color, NULL, &dst_color->color, &tsrc, false);
 	color_correct(dst, &tsrc);
 
-	image = XGetImage(dpy, dst->d,
-			  0, 0, 5, 5,
-			  0xffffffff, ZPixmap);
+	image = get_image(dpy, dst, 0, 0, 5, 5);
+	get_pixels_from_image(image, dst, 0, 0, 5, 5, &pixels[0][0]);
+	release_image(image);
 
 	for (x = 0; x < 5; x++) {
 	    for (y = 0; y < 5; y++) {
-		color4d expected, tested;
+		color4d expected, *tested = &pixels[y][x];
 
 		if (x >= 2 && x < 4 && y >= 2 && y < 4) {
 			expected = tsrc;
@@ -193,11 +194,9 @@ trifan_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 			expected = tdst;
 		}
 
-		get_pixel_from_image(image, dst, x, y, &tested);
-
-		if (eval_diff(&dst->format->direct, &expected, &tested) > 2.) {
-			print_fail("triangles", &expected, &tested, x,y,
-				   eval_diff(&dst->format->direct, &expected, &tested));
+		if (eval_diff(&dst->format->direct, &expected, tested) > 2.) {
+			print_fail("triangles", &expected, tested, x,y,
+				   eval_diff(&dst->format->direct, &expected, tested));
 			success = false;
 		}
 	    }
@@ -210,7 +209,6 @@ trifan_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 		    dst_color->color.r, dst_color->color.g,
 		    dst_color->color.b, dst_color->color.a);
 	}
-	XDestroyImage(image);
 
 	return success;
 }
@@ -224,6 +222,7 @@ tristrip_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 	int x, y;
 	bool success = true;
 	XImage *image;
+	color4d pixels[5][5];
 
 	points[0].x = XDoubleToFixed(2);
 	points[0].y = XDoubleToFixed(2);
@@ -251,13 +250,13 @@ tristrip_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 	do_composite(ops[op].op, &src_color->color, NULL, &dst_color->color, &tsrc, false);
 	color_correct(dst, &tsrc);
 
-	image = XGetImage(dpy, dst->d,
-			  0, 0, 5, 5,
-			  0xffffffff, ZPixmap);
+	image = get_image(dpy, dst, 0, 0, 5, 5);
+	get_pixels_from_image(image, dst, 0, 0, 5, 5, &pixels[0][0]);
+	release_image(image);
 
 	for (x = 0; x < 5; x++) {
 	    for (y = 0; y < 5; y++) {
-		color4d expected, tested;
+		color4d expected, *tested = &pixels[y][x];
 
 		if (x >= 2 && x < 4 && y >= 2 && y < 4) {
 			expected = tsrc;
@@ -265,11 +264,9 @@ tristrip_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 			expected = tdst;
 		}
 
-		get_pixel_from_image(image, dst, x, y, &tested);
-
-		if (eval_diff(&dst->format->direct, &expected, &tested) > 2.) {
-		    print_fail("triangles", &expected, &tested, x, y,
-			       eval_diff(&dst->format->direct, &expected, &tested));
+		if (eval_diff(&dst->format->direct, &expected, tested) > 2.) {
+		    print_fail("triangles", &expected, tested, x, y,
+			       eval_diff(&dst->format->direct, &expected, tested));
 		    success = false;
 		}
 	    }
@@ -282,7 +279,211 @@ tristrip_test(Display *dpy, picture_info *win, picture_info *dst, int op,
 		    dst_color->color.r, dst_color->color.g,
 		    dst_color->color.b, dst_color->color.a);
 	}
-	XDestroyImage(image);
 
 	return success;
 }
+
+/* Size of the destination the triangle benchmark draws into. */
+#define MESH_SIZE	256
+
+enum mesh_kind {
+	MESH_SOUP,
+	MESH_SLIVERS,
+	MESH_STRIP,
+	MESH_FAN,
+};
+
+static const char *mesh_names[] = {
+	[MESH_SOUP] = "soup",
+	[MESH_SLIVERS] = "slivers",
+	[MESH_STRIP] = "strip",
+	[MESH_FAN] = "fan",
+};
+
+struct triangles_bench {
+	int op;
+	enum mesh_kind kind;
+	const picture_info *src, *dst;
+	XRenderPictFormat *mask_format;
+	XTriangle *triangles;
+	XPointFixed *points;
+	int n;
+};
+
+static void
+triangles_bench_func(Display *dpy, void *data, int iterations)
+{
+	struct triangles_bench *b = data;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		switch (b->kind) {
+		case MESH_SOUP:
+		case MESH_SLIVERS:
+			XRenderCompositeTriangles(dpy, b->op, b->src->pict,
+			    b->dst->pict, b->mask_format, 0, 0,
+			    b->triangles, b->n);
+			break;
+		case MESH_STRIP:
+			XRenderCompositeTriStrip(dpy, b->op, b->src->pict,
+			    b->dst->pict, b->mask_format, 0, 0,
+			    b->points, b->n + 2);
+			break;
+		case MESH_FAN:
+			XRenderCompositeTriFan(dpy, b->op, b->src->pict,
+			    b->dst->pict, b->mask_format, 0, 0,
+			    b->points, b->n + 2);
+			break;
+		}
+	}
+}
+
+static XFixed
+random_coord(unsigned int *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 8) % (MESH_SIZE << 16);
+}
+
+/* Fills in a deterministic mesh of n triangles covering the destination:
+ * random triangles or thin vertical slivers in b->triangles, or the n + 2
+ * points of a zigzag strip or a fan around the center in b->points.
+ */
+static void
+make_mesh(struct triangles_bench *b, enum mesh_kind kind, int n)
+{
+	unsigned int seed = 1;
+	XFixed w = XDoubleToFixed((double)MESH_SIZE / n);
+	int i;
+
+	b->kind = kind;
+	b->n = n;
+
+	switch (kind) {
+	case MESH_SOUP:
+		for (i = 0; i < n; i++) {
+			b->triangles[i].p1.x = random_coord(&seed);
+			b->triangles[i].p1.y = random_coord(&seed);
+			b->triangles[i].p2.x = random_coord(&seed);
+			b->triangles[i].p2.y = random_coord(&seed);
+			b->triangles[i].p3.x = random_coord(&seed);
+			b->triangles[i].p3.y = random_coord(&seed);
+		}
+		break;
+	case MESH_SLIVERS:
+		for (i = 0; i < n; i++) {
+			b->triangles[i].p1.x = i * w;
+			b->triangles[i].p1.y = 0;
+			b->triangles[i].p2.x = i * w + w / 2;
+			b->triangles[i].p2.y = XDoubleToFixed(MESH_SIZE);
+			b->triangles[i].p3.x = (i + 1) * w;
+			b->triangles[i].p3.y = 0;
+		}
+		break;
+	case MESH_STRIP:
+		w = XDoubleToFixed((double)MESH_SIZE / (n / 2 + 1));
+		for (i = 0; i < n + 2; i++) {
+			b->points[i].x = (i / 2) * w + (i % 2) * w / 2;
+			b->points[i].y = (i % 2) ? XDoubleToFixed(MESH_SIZE) : 0;
+		}
+		break;
+	case MESH_FAN:
+		b->points[0].x = XDoubleToFixed(MESH_SIZE / 2);
+		b->points[0].y = XDoubleToFixed(MESH_SIZE / 2);
+		for (i = 0; i <= n; i++) {
+			double angle = 2 * M_PI * i / n;
+
+			b->points[i + 1].x = XDoubleToFixed(MESH_SIZE / 2 *
+			    (1 + cos(angle)));
+			b->points[i + 1].y = XDoubleToFixed(MESH_SIZE / 2 *
+			    (1 + sin(angle)));
+		}
+		break;
+	}
+}
+
+/* Prints the largest number of triangles Xlib sends in a single request.
+ * Without BIG-REQUESTS, larger meshes are split over several requests.
+ */
+static void
+print_request_limits(Display *dpy)
+{
+	long max_len = XExtendedMaxRequestSize(dpy);
+
+	if (max_len != 0) {
+		printf("Triangle requests use BIG-REQUESTS, up to %ld "
+		       "triangles or %ld strip/fan triangles per request\n",
+		       (max_len * 4 - sz_xRenderTrianglesReq) / sz_xTriangle,
+		       (max_len * 4 - sz_xRenderTriStripReq) /
+		       sz_xPointFixed - 2);
+		return;
+	}
+
+	max_len = XMaxRequestSize(dpy);
+	printf("Triangle requests are split beyond %ld triangles or %ld "
+	       "strip/fan triangles\n",
+	       (max_len * 4 - sz_xRenderTrianglesReq) / sz_xTriangle,
+	       (max_len * 4 - sz_xRenderTriStripReq) / sz_xPointFixed - 2);
+}
+
+/* Times each op drawing meshes of 10 to 100000 triangles through an A8 mask
+ * onto a destination of the given format, reporting triangles/s.
+ */
+void
+triangles_bench(Display *dpy, XRenderPictFormat *dst_format,
+		const int *op, int num_op, const picture_info *src)
+{
+	static const int counts[] = { 10, 100, 1000, 10000, 100000 };
+	int max_count = counts[ARRAY_SIZE(counts) - 1];
+	struct triangles_bench b;
+	struct bench_desc desc;
+	picture_info dst;
+	char name[80], *dst_name;
+	unsigned int c;
+	int i, kind;
+
+	print_request_limits(dpy);
+
+	dst.format = dst_format;
+	dst.d = XCreatePixmap(dpy, DefaultRootWindow(dpy), MESH_SIZE,
+			      MESH_SIZE, dst_format->depth);
+	dst.pict = XRenderCreatePicture(dpy, dst.d, dst_format, 0, NULL);
+	describe_format(&dst_name, NULL, dst_format);
+
+	b.src = src;
+	b.dst = &dst;
+	b.mask_format = XRenderFindStandardFormat(dpy, PictStandardA8);
+	b.triangles = malloc(sizeof(XTriangle) * max_count);
+	b.points = malloc(sizeof(XPointFixed) * (max_count + 2));
+	if (b.triangles == NULL || b.points == NULL)
+		errx(1, "malloc error");
+
+	desc.name = name;
+	desc.func = triangles_bench_func;
+	desc.data = &b;
+	desc.unit_name = "triangles";
+	desc.pixels = 0;
+
+	for (kind = MESH_SOUP; kind <= MESH_FAN; kind++) {
+	    for (c = 0; c < ARRAY_SIZE(counts); c++) {
+		make_mesh(&b, kind, counts[c]);
+		desc.units = counts[c];
+		desc.iterations = max(1, min(bench_iterations,
+					     max_count / counts[c]));
+
+		for (i = 0; i < num_op; i++) {
+		    b.op = ops[op[i]].op;
+		    snprintf(name, sizeof(name), "%s %s %s %d",
+			     ops[op[i]].name, dst_name, mesh_names[kind],
+			     counts[c]);
+		    run_benchmark(dpy, &desc);
+		}
+	    }
+	}
+
+	free(b.triangles);
+	free(b.points);
+	free(dst_name);
+	XRenderFreePicture(dpy, dst.pict);
+	XFreePixmap(dpy, dst.d);
+}
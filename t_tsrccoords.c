@@ -20,8 +20,10 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "rendercheck.h"
 
@@ -116,9 +118,7 @@ trans_coords_test(Display *dpy, picture_info *win, picture_info *white,
 		    win->pict, 0, 0, 0, 0, 0, 0, TEST_WIDTH, TEST_HEIGHT);
 	}
 
-	image = XGetImage(dpy, win->d,
-			  0, 0, TEST_WIDTH, TEST_HEIGHT,
-			  0xffffffff, ZPixmap);
+	image = get_image(dpy, win, 0, 0, TEST_WIDTH, TEST_HEIGHT);
 
 	for (y = 0; y < TEST_HEIGHT; y++) {
 		for (x = 0; x < TEST_WIDTH; x++) {
@@ -162,7 +162,7 @@ trans_coords_test(Display *dpy, picture_info *win, picture_info *white,
 			printf("\n");
 		}
 	}
-	XDestroyImage(image);
+	release_image(image);
 
 	init_transform(&t);
 
@@ -172,3 +172,197 @@ trans_coords_test(Display *dpy, picture_info *win, picture_info *white,
 
 	return !failed;
 }
+
+/* Size of the checkerboard source and of the destination of the transform
+ * benchmark.
+ */
+#define TRANSFORM_BENCH_SIZE 512
+
+/* Each transform either scales by scale about the origin, rotates by angle
+ * degrees about the center of the source, or adds a perspective term.
+ */
+static const struct {
+	const char *name;
+	double scale, angle, perspective;
+} transform_classes[] = {
+	{ "identity",		1,	0,	0 },
+	{ "scale 1/16x",	1. / 16, 0,	0 },
+	{ "scale 1/4x",		1. / 4,	0,	0 },
+	{ "scale 1/2x",		1. / 2,	0,	0 },
+	{ "scale 3/4x",		3. / 4,	0,	0 },
+	{ "scale 1.5x",		1.5,	0,	0 },
+	{ "scale 2x",		2,	0,	0 },
+	{ "scale 4x",		4,	0,	0 },
+	{ "scale 16x",		16,	0,	0 },
+	{ "rotate 90",		1,	90,	0 },
+	{ "rotate 30",		1,	30,	0 },
+	{ "rotate 7",		1,	7,	0 },
+	{ "projective 1/1024",	1,	0,	1. / 1024 },
+	{ "projective 1/256",	1,	0,	1. / 256 },
+};
+
+/* A 3x3 box blur for the convolution filter: width, height, then the
+ * weights.
+ */
+static const double box_kernel[] = {
+	3, 3,
+	1. / 9, 1. / 9, 1. / 9,
+	1. / 9, 1. / 9, 1. / 9,
+	1. / 9, 1. / 9, 1. / 9,
+};
+
+static const char *bench_filters[] = {
+	FilterNearest, FilterBilinear, FilterGood, FilterBest, FilterConvolution,
+};
+
+struct transform_bench {
+	Picture src, dst;
+	int size;
+};
+
+static void
+transform_bench_func(Display *dpy, void *data, int iterations)
+{
+	struct transform_bench *b = data;
+	int i;
+
+	for (i = 0; i < iterations; i++) {
+		XRenderComposite(dpy, PictOpOver, b->src, None, b->dst,
+				 0, 0, 0, 0, 0, 0, b->size, b->size);
+	}
+}
+
+/* Sets t to the destination-to-source matrix for transform class i. */
+static void
+make_transform(XTransform *t, unsigned int i)
+{
+	double a = transform_classes[i].angle * M_PI / 180;
+	double s = transform_classes[i].scale;
+	double c = TRANSFORM_BENCH_SIZE / 2;
+
+	init_transform(t);
+	if (a != 0) {
+		t->matrix[0][0] = XDoubleToFixed(cos(a));
+		t->matrix[0][1] = XDoubleToFixed(sin(a));
+		t->matrix[0][2] = XDoubleToFixed(c - c * cos(a) - c * sin(a));
+		t->matrix[1][0] = XDoubleToFixed(-sin(a));
+		t->matrix[1][1] = XDoubleToFixed(cos(a));
+		t->matrix[1][2] = XDoubleToFixed(c + c * sin(a) - c * cos(a));
+	} else {
+		t->matrix[0][0] = XDoubleToFixed(1 / s);
+		t->matrix[1][1] = XDoubleToFixed(1 / s);
+	}
+	t->matrix[2][0] = XDoubleToFixed(transform_classes[i].perspective);
+	t->matrix[2][1] = XDoubleToFixed(transform_classes[i].perspective);
+}
+
+static bool
+filter_supported(XFilters *filters, const char *name)
+{
+	int i;
+
+	for (i = 0; filters != NULL && i < filters->nfilter; i++) {
+		if (strcmp(filters->filter[i], name) == 0)
+			return true;
+	}
+	return false;
+}
+
+/* Times Over of a checkerboard source through each transform class with each
+ * filter the server has, reporting Mpixels/s.  Downscales only composite the
+ * part of the destination the source covers.
+ */
+static void
+bench_transforms(Display *dpy)
+{
+	XRenderPictFormat *argb32_format =
+	    XRenderFindStandardFormat(dpy, PictStandardARGB32);
+	XRenderColor white = { 0xffff, 0xffff, 0xffff, 0xffff };
+	XRenderColor red = { 0xffff, 0, 0, 0xffff };
+	XRectangle squares[(TRANSFORM_BENCH_SIZE / 16) *
+			   (TRANSFORM_BENCH_SIZE / 32)];
+	XFixed kernel[ARRAY_SIZE(box_kernel)];
+	struct transform_bench b;
+	struct bench_desc desc;
+	Pixmap src_pix, dst_pix;
+	XFilters *filters;
+	XTransform t;
+	char name[80];
+	unsigned int i, f;
+	int x, y, n = 0;
+
+	src_pix = XCreatePixmap(dpy, DefaultRootWindow(dpy),
+				TRANSFORM_BENCH_SIZE, TRANSFORM_BENCH_SIZE,
+				argb32_format->depth);
+	b.src = XRenderCreatePicture(dpy, src_pix, argb32_format, 0, NULL);
+	dst_pix = XCreatePixmap(dpy, DefaultRootWindow(dpy),
+				TRANSFORM_BENCH_SIZE, TRANSFORM_BENCH_SIZE,
+				argb32_format->depth);
+	b.dst = XRenderCreatePicture(dpy, dst_pix, argb32_format, 0, NULL);
+
+	/* A checkerboard of 16x16 squares, so that filtering has edges to
+	 * work on.
+	 */
+	for (y = 0; y < TRANSFORM_BENCH_SIZE / 16; y++) {
+		for (x = y & 1; x < TRANSFORM_BENCH_SIZE / 16; x += 2) {
+			squares[n].x = x * 16;
+			squares[n].y = y * 16;
+			squares[n].width = 16;
+			squares[n].height = 16;
+			n++;
+		}
+	}
+	XRenderFillRectangle(dpy, PictOpSrc, b.src, &white, 0, 0,
+			     TRANSFORM_BENCH_SIZE, TRANSFORM_BENCH_SIZE);
+	XRenderFillRectangles(dpy, PictOpSrc, b.src, &red, squares, n);
+
+	for (i = 0; i < ARRAY_SIZE(box_kernel); i++)
+		kernel[i] = XDoubleToFixed(box_kernel[i]);
+
+	filters = XRenderQueryFilters(dpy, src_pix);
+
+	desc.name = name;
+	desc.func = transform_bench_func;
+	desc.data = &b;
+	desc.units = 1;
+	desc.unit_name = "composites";
+
+	for (f = 0; f < ARRAY_SIZE(bench_filters); f++) {
+		bool convolution = strcmp(bench_filters[f],
+					  FilterConvolution) == 0;
+
+		if (!filter_supported(filters, bench_filters[f])) {
+			printf("Skipping unsupported filter %s\n",
+			       bench_filters[f]);
+			continue;
+		}
+
+		XRenderSetPictureFilter(dpy, b.src, bench_filters[f],
+					convolution ? kernel : NULL,
+					convolution ? ARRAY_SIZE(kernel) : 0);
+
+		for (i = 0; i < ARRAY_SIZE(transform_classes); i++) {
+			make_transform(&t, i);
+			XRenderSetPictureTransform(dpy, b.src, &t);
+
+			b.size = min(TRANSFORM_BENCH_SIZE,
+			    (int)(TRANSFORM_BENCH_SIZE *
+				  transform_classes[i].scale));
+			desc.pixels = b.size * b.size;
+			desc.iterations = max(1, min(bench_iterations,
+			    (1 << 24) / (int)desc.pixels));
+			snprintf(name, sizeof(name), "%s %s", bench_filters[f],
+				 transform_classes[i].name);
+			run_benchmark(dpy, &desc);
+		}
+	}
+
+	XFree(filters);
+	XRenderFreePicture(dpy, b.src);
+	XRenderFreePicture(dpy, b.dst);
+	XFreePixmap(dpy, src_pix);
+	XFreePixmap(dpy, dst_pix);
+}
+
+DECLARE_RENDERCHECK_ARG_BENCH(transforms, "source transforms and filters",
+			      bench_transforms);
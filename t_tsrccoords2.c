@@ -121,9 +121,7 @@ trans_srccoords_test_2(Display *dpy, picture_info *win, picture_info *white,
 		    &pa);
 	}
 
-	image = XGetImage(dpy, win->d,
-			  0, 0, 5, 5,
-			  0xffffffff, ZPixmap);
+	image = get_image(dpy, win, 0, 0, 5, 5);
 
 	for (i = 0; i < 25; i++) {
 		int x = i % 5, y = i / 5, srcx, srcy;
@@ -171,7 +169,7 @@ trans_srccoords_test_2(Display *dpy, picture_info *win, picture_info *white,
 		}
 	}
 
-	XDestroyImage(image);
+	release_image(image);
 	destroy_target_picture(dpy, src);
 
 	return !failed;
@@ -20,6 +20,7 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -112,30 +113,44 @@ color_correct(picture_info *pi, color4d *color)
 		color->a = round_pix(color->a, pi->format->direct.alphaMask);
 }
 
-void
-get_pixel_from_image(XImage *image,
-		     const picture_info *pi,
-		     int x, int y,
-		     color4d *color)
-{
-	unsigned long val;
+/* Channel masks of a picture format, shifted down to bit 0, along with the
+ * shifts needed to extract them from a pixel value.
+ */
+struct pixel_layout {
 	unsigned long rm, gm, bm, am;
-	XRenderDirectFormat *layout = &pi->format->direct;
+	int rs, gs, bs, as;
+};
 
-	val = XGetPixel(image, x, y);
+static void
+get_pixel_layout(const XRenderDirectFormat *direct,
+		 struct pixel_layout *layout)
+{
+	layout->rm = direct->redMask;
+	layout->gm = direct->greenMask;
+	layout->bm = direct->blueMask;
+	layout->am = direct->alphaMask;
+	layout->rs = direct->red;
+	layout->gs = direct->green;
+	layout->bs = direct->blue;
+	layout->as = direct->alpha;
+}
 
-	rm = (unsigned long)layout->redMask << layout->red;
-	gm = (unsigned long)layout->greenMask << layout->green;
-	bm = (unsigned long)layout->blueMask << layout->blue;
-	am = (unsigned long)layout->alphaMask << layout->alpha;
-	if (am != 0)
-		color->a = (double)(val & am) / (double)am;
+static inline void
+decode_pixel(const struct pixel_layout *layout, unsigned long val,
+	     color4d *color)
+{
+	if (layout->am != 0)
+		color->a = (double)((val >> layout->as) & layout->am) /
+			(double)layout->am;
 	else
 		color->a = 1.0;
-	if (rm != 0) {
-		color->r = (double)(val & rm) / (double)rm;
-		color->g = (double)(val & gm) / (double)gm;
-		color->b = (double)(val & bm) / (double)bm;
+	if (layout->rm != 0) {
+		color->r = (double)((val >> layout->rs) & layout->rm) /
+			(double)layout->rm;
+		color->g = (double)((val >> layout->gs) & layout->gm) /
+			(double)layout->gm;
+		color->b = (double)((val >> layout->bs) & layout->bm) /
+			(double)layout->bm;
 	} else {
 		color->r = 0.0;
 		color->g = 0.0;
@@ -143,6 +158,88 @@ get_pixel_from_image(XImage *image,
 	}
 }
 
+static bool
+image_is_host_order(XImage *image)
+{
+	static const uint32_t one = 1;
+	int host_order = *(const uint8_t *)&one ? LSBFirst : MSBFirst;
+
+	return image->bits_per_pixel == 8 || image->byte_order == host_order;
+}
+
+/* Decodes the w x h region of image starting at (x, y) into colors, stored
+ * row by row.  8, 16 and 32bpp ZPixmap images in the host's byte order (so
+ * every format create_formats_list() accepts, on a local server) are read
+ * straight out of the image data, and anything else goes through XGetPixel().
+ */
+void
+get_pixels_from_image(XImage *image,
+		      const picture_info *pi,
+		      int x, int y, int w, int h,
+		      color4d *colors)
+{
+	struct pixel_layout layout;
+	int i, j;
+
+	get_pixel_layout(&pi->format->direct, &layout);
+
+	if (image->format != ZPixmap || !image_is_host_order(image)) {
+		for (j = 0; j < h; j++) {
+			for (i = 0; i < w; i++) {
+				decode_pixel(&layout,
+					     XGetPixel(image, x + i, y + j),
+					     colors++);
+			}
+		}
+		return;
+	}
+
+	for (j = 0; j < h; j++) {
+		const char *row = image->data +
+			(y + j) * image->bytes_per_line;
+
+		switch (image->bits_per_pixel) {
+		case 32: {
+			const uint32_t *p = (const uint32_t *)row + x;
+
+			for (i = 0; i < w; i++)
+				decode_pixel(&layout, p[i], colors++);
+			break;
+		}
+		case 16: {
+			const uint16_t *p = (const uint16_t *)row + x;
+
+			for (i = 0; i < w; i++)
+				decode_pixel(&layout, p[i], colors++);
+			break;
+		}
+		case 8: {
+			const uint8_t *p = (const uint8_t *)row + x;
+
+			for (i = 0; i < w; i++)
+				decode_pixel(&layout, p[i], colors++);
+			break;
+		}
+		default:
+			for (i = 0; i < w; i++) {
+				decode_pixel(&layout,
+					     XGetPixel(image, x + i, y + j),
+					     colors++);
+			}
+			break;
+		}
+	}
+}
+
+void
+get_pixel_from_image(XImage *image,
+		     const picture_info *pi,
+		     int x, int y,
+		     color4d *color)
+{
+	get_pixels_from_image(image, pi, x, y, 1, 1, color);
+}
+
 void
 get_pixel(Display *dpy,
 	  const picture_info *pi,
@@ -151,9 +248,9 @@ get_pixel(Display *dpy,
 {
 	XImage *image;
 
-	image = XGetImage(dpy, pi->d, x, y, 1, 1, 0xffffffff, ZPixmap);
+	image = get_image(dpy, pi, x, y, 1, 1);
 	get_pixel_from_image(image, pi, 0, 0, color);
-	XDestroyImage(image);
+	release_image(image);
 }
 
 void
@@ -314,6 +411,17 @@ create_formats_list(Display *dpy)
     }
 }
 
+/* Starts charging the latency samples, CPU time and performance counts that
+ * follow to the named test group or benchmark.
+ */
+static void
+begin_group(const char *name)
+{
+    latency_group(name);
+    cpu_group(name);
+    perf_group(name);
+}
+
 bool
 do_tests(Display *dpy, picture_info *win)
 {
@@ -330,6 +438,10 @@ do_tests(Display *dpy, picture_info *win)
 	int num_test_dst = 0;
 
 	create_formats_list(dpy);
+	results_header(dpy);
+	init_readback(dpy);
+	if (latency_mode)
+		latency_init(dpy);
 
 	num_dests = nformats;
 	dests = (picture_info *)malloc(num_dests * sizeof(dests[0]));
@@ -468,6 +580,14 @@ do {								\
 		if (!(enabled_tests & test->bit))
 			continue;
 
+		begin_group(test->arg_name);
+
+		/* Tests run by other jobs count as passed here. */
+		if (!shard_begin()) {
+			success_mask |= test->bit;
+			continue;
+		}
+
 		result = test->func(dpy);
 		tests_total += result.tests;
 		tests_passed += result.passed;
@@ -479,17 +599,32 @@ do {								\
 	if (enabled_tests & TEST_FILL) {
 		bool ok, group_ok = true;
 
-		printf("Beginning testing of filling of 1x1R pictures\n");
-		for (i = 0; i < num_tests; i++) {
-			ok = fill_test(dpy, win, &pictures_1x1[i]);
-			RECORD_RESULTS();
+		bool *fill_ok;
+
+		begin_group("fill");
+
+		fill_ok = malloc(num_tests * sizeof(bool));
+		if (fill_ok == NULL)
+			errx(1, "malloc error");
+
+		if (shard_begin()) {
+			printf("Beginning testing of filling of 1x1R pictures\n");
+			fill_test(dpy, win, pictures_1x1, 1, fill_ok);
+			for (i = 0; i < num_tests; i++) {
+				ok = fill_ok[i];
+				RECORD_RESULTS();
+			}
 		}
 
-		printf("Beginning testing of filling of 10x10 pictures\n");
-		for (i = 0; i < num_tests; i++) {
-			ok = fill_test(dpy, win, &pictures_10x10[i]);
-			RECORD_RESULTS();
+		if (shard_begin()) {
+			printf("Beginning testing of filling of 10x10 pictures\n");
+			fill_test(dpy, win, pictures_10x10, 10, fill_ok);
+			for (i = 0; i < num_tests; i++) {
+				ok = fill_ok[i];
+				RECORD_RESULTS();
+			}
 		}
+		free(fill_ok);
 		if (group_ok)
 			success_mask |= TEST_FILL;
 	}
@@ -497,12 +632,16 @@ do {								\
 	if (enabled_tests & TEST_DSTCOORDS) {
 		bool ok, group_ok = true;
 
-		printf("Beginning dest coords test\n");
-		for (i = 0; i < 2; i++) {
-			ok = dstcoords_test(dpy, win,
-			    i == 0 ? PictOpSrc : PictOpOver, win,
-			    argb32white, argb32red);
-			RECORD_RESULTS();
+		begin_group("dcoords");
+
+		if (shard_begin()) {
+			printf("Beginning dest coords test\n");
+			for (i = 0; i < 2; i++) {
+				ok = dstcoords_test(dpy, win,
+				    i == 0 ? PictOpSrc : PictOpOver, win,
+				    argb32white, argb32red);
+				RECORD_RESULTS();
+			}
 		}
 		if (group_ok)
 			success_mask |= TEST_DSTCOORDS;
@@ -511,9 +650,13 @@ do {								\
 	if (enabled_tests & TEST_SRCCOORDS) {
 		bool ok, group_ok = true;
 
-		printf("Beginning src coords test\n");
-		ok = srccoords_test(dpy, win, argb32white, false);
-		RECORD_RESULTS();
+		begin_group("scoords");
+
+		if (shard_begin()) {
+			printf("Beginning src coords test\n");
+			ok = srccoords_test(dpy, win, argb32white, false);
+			RECORD_RESULTS();
+		}
 		if (group_ok)
 			success_mask |= TEST_SRCCOORDS;
 	}
@@ -521,9 +664,13 @@ do {								\
 	if (enabled_tests & TEST_MASKCOORDS) {
 		bool ok, group_ok = true;
 
-		printf("Beginning mask coords test\n");
-		ok = srccoords_test(dpy, win, argb32white, true);
-		RECORD_RESULTS();
+		begin_group("mcoords");
+
+		if (shard_begin()) {
+			printf("Beginning mask coords test\n");
+			ok = srccoords_test(dpy, win, argb32white, true);
+			RECORD_RESULTS();
+		}
 		if (group_ok)
 			success_mask |= TEST_MASKCOORDS;
 	}
@@ -531,13 +678,20 @@ do {								\
 	if (enabled_tests & TEST_TSRCCOORDS) {
 		bool ok, group_ok = true;
 
-		printf("Beginning transformed src coords test\n");
-		ok = trans_coords_test(dpy, win, argb32white, false);
-		RECORD_RESULTS();
+		begin_group("tscoords");
 
-		printf("Beginning transformed src coords test 2\n");
-		ok = trans_srccoords_test_2(dpy, win, argb32white, false);
-		RECORD_RESULTS();
+		if (shard_begin()) {
+			printf("Beginning transformed src coords test\n");
+			ok = trans_coords_test(dpy, win, argb32white, false);
+			RECORD_RESULTS();
+		}
+
+		if (shard_begin()) {
+			printf("Beginning transformed src coords test 2\n");
+			ok = trans_srccoords_test_2(dpy, win, argb32white,
+			    false);
+			RECORD_RESULTS();
+		}
 		if (group_ok)
 			success_mask |= TEST_TSRCCOORDS;
 	}
@@ -545,13 +699,20 @@ do {								\
 	if (enabled_tests & TEST_TMASKCOORDS) {
 		bool ok, group_ok = true;
 
-		printf("Beginning transformed mask coords test\n");
-		ok = trans_coords_test(dpy, win, argb32white, true);
-		RECORD_RESULTS();
+		begin_group("tmcoords");
 
-		printf("Beginning transformed mask coords test 2\n");
-		ok = trans_srccoords_test_2(dpy, win, argb32white, true);
-		RECORD_RESULTS();
+		if (shard_begin()) {
+			printf("Beginning transformed mask coords test\n");
+			ok = trans_coords_test(dpy, win, argb32white, true);
+			RECORD_RESULTS();
+		}
+
+		if (shard_begin()) {
+			printf("Beginning transformed mask coords test 2\n");
+			ok = trans_srccoords_test_2(dpy, win, argb32white,
+			    true);
+			RECORD_RESULTS();
+		}
 
 		if (group_ok)
 			success_mask |= TEST_TMASKCOORDS;
@@ -560,9 +721,14 @@ do {								\
 	if (enabled_tests & TEST_BLEND) {
 		bool ok, group_ok = true;
 
+		begin_group("blend");
+
 		for (j = 0; j <= num_dests; j++) {
 		    picture_info *pi;
 
+		    if (!shard_begin())
+			continue;
+
 		    if (j != num_dests)
 			pi = &dests[j];
 		    else
@@ -583,9 +749,14 @@ do {								\
 	if (enabled_tests & TEST_COMPOSITE) {
 		bool ok, group_ok = true;
 
+		begin_group("composite");
+
 		for (j = 0; j <= num_dests; j++) {
 		    picture_info *pi;
 
+		    if (!shard_begin())
+			continue;
+
 		    if (j != num_dests)
 			pi = &dests[j];
 		    else
@@ -608,9 +779,14 @@ do {								\
 	if (enabled_tests & TEST_CACOMPOSITE) {
 		bool ok, group_ok = true;
 
+		begin_group("cacomposite");
+
 		for (j = 0; j <= num_dests; j++) {
 		    picture_info *pi;
 
+		    if (!shard_begin())
+			continue;
+
 		    if (j != num_dests)
 			pi = &dests[j];
 		    else
@@ -633,9 +809,13 @@ do {								\
         if (enabled_tests & TEST_GRADIENTS) {
 	    bool ok, group_ok = true;
 
-	    printf("Beginning render to linear gradient test\n");
-	    ok = render_to_gradient_test(dpy, &pictures_1x1[0]);
-	    RECORD_RESULTS();
+	    begin_group("gradients");
+
+	    if (shard_begin()) {
+		printf("Beginning render to linear gradient test\n");
+		ok = render_to_gradient_test(dpy, &pictures_1x1[0]);
+		RECORD_RESULTS();
+	    }
 
             for (i = 0; i < num_ops; i++) {
 		if (ops[i].disabled)
@@ -643,7 +823,10 @@ do {								\
 
                 for (j = 0; j <= num_dests; j++) {
                     picture_info *pi;
-                    
+
+                    if (!shard_begin())
+                        continue;
+
                     if (j != num_dests)
                         pi = &dests[j];
                     else
@@ -665,13 +848,18 @@ do {								\
         if (enabled_tests & TEST_REPEAT) {
 	    bool ok, group_ok = true;
 
+	    begin_group("repeat");
+
             for (i = 0; i < num_ops; i++) {
 		if (ops[i].disabled)
 		    continue;
 
                 for (j = 0; j <= num_dests; j++) {
                     picture_info *pi;
-                    
+
+                    if (!shard_begin())
+                        continue;
+
                     if (j != num_dests)
                         pi = &dests[j];
                     else
@@ -702,6 +890,8 @@ do {								\
 	if (enabled_tests & TEST_TRIANGLES) {
 	    bool ok, group_ok = true;
 
+	    begin_group("triangles");
+
 	    for (i = 0; i < num_ops; i++) {
 		if (ops[i].disabled)
 		    continue;
@@ -709,6 +899,9 @@ do {								\
 		for (j = 0; j <= num_dests; j++) {
 			picture_info *pi;
 
+			if (!shard_begin())
+			    continue;
+
 			if (j != num_dests)
 			    pi = &dests[j];
 			else
@@ -740,13 +933,173 @@ do {								\
         if (enabled_tests & TEST_BUG7366) {
 	    bool ok, group_ok = true;
 
-	    ok = bug7366_test(dpy);
-	    RECORD_RESULTS();
+	    begin_group("bug7366");
+
+	    if (shard_begin()) {
+		ok = bug7366_test(dpy);
+		RECORD_RESULTS();
+	    }
 
 	    if (group_ok)
 		success_mask |= TEST_BUG7366;
 	}
 
+	for_each_bench(bench) {
+		if (!(enabled_benchmarks & bench->bit))
+			continue;
+
+		begin_group(bench->arg_name);
+
+		if (!shard_begin())
+			continue;
+
+		printf("Beginning %s benchmark\n", bench->long_name);
+		bench->func(dpy);
+	}
+
+	if (enabled_benchmarks & BENCH_COMPOSITE) {
+		const picture_info **bench_src, **bench_mask;
+		int num_bench_src = 0, num_bench_mask = 0;
+
+		begin_group("composite bench");
+
+		/* Opaque white sources of each kind, and translucent masks, so
+		 * that servers can't skip the blending.
+		 */
+		bench_src = malloc(sizeof(picture_info *) * (2 * nformats + 1));
+		bench_mask = malloc(sizeof(picture_info *) * (nformats + 1));
+		if (bench_src == NULL || bench_mask == NULL)
+			errx(1, "malloc error");
+		bench_mask[num_bench_mask++] = NULL;
+		for (i = 0; i < nformats; i++) {
+			bench_src[num_bench_src++] = &pictures_1x1[i];
+			bench_src[num_bench_src++] = &pictures_10x10[i];
+			bench_mask[num_bench_mask++] =
+			    &pictures_1x1[4 * nformats + i];
+		}
+		bench_src[num_bench_src++] = &pictures_solid[0];
+
+		for (j = 0; j <= num_dests; j++) {
+			picture_info *pi;
+
+			if (!shard_begin())
+				continue;
+
+			if (j != num_dests)
+				pi = &dests[j];
+			else
+				pi = win;
+
+			printf("Beginning composite benchmark on %s\n",
+			    pi->name);
+			composite_bench(dpy, pi, test_ops, num_test_ops,
+			    bench_src, num_bench_src,
+			    bench_mask, num_bench_mask);
+		}
+
+		free(bench_src);
+		free(bench_mask);
+	}
+
+	if (enabled_benchmarks & BENCH_SIZES) {
+		const picture_info **bench_src;
+
+		begin_group("sizes bench");
+
+		/* Opaque white, which repeats to any size. */
+		bench_src = malloc(sizeof(picture_info *) * nformats);
+		if (bench_src == NULL)
+			errx(1, "malloc error");
+		for (i = 0; i < nformats; i++)
+			bench_src[i] = &pictures_1x1[i];
+
+		for (j = 0; j < nformats; j++) {
+			if (!shard_begin())
+				continue;
+
+			printf("Beginning size sweep benchmark on %s\n",
+			    formats[j].name);
+			composite_size_bench(dpy, formats[j].format,
+			    test_ops, num_test_ops, bench_src, nformats);
+		}
+
+		free(bench_src);
+	}
+
+	if (enabled_benchmarks & BENCH_WARMUP) {
+		begin_group("warmup bench");
+
+		for (j = 0; j < nformats; j++) {
+			if (!shard_begin())
+				continue;
+
+			printf("Beginning warm-up benchmark on %s\n",
+			    formats[j].name);
+			composite_warmup_bench(dpy, formats[j].format,
+			    test_ops, num_test_ops);
+		}
+	}
+
+	if (enabled_benchmarks & BENCH_TRIANGLES) {
+		begin_group("triangles bench");
+
+		for (j = 0; j < nformats; j++) {
+			if (!shard_begin())
+				continue;
+
+			printf("Beginning triangles benchmark on %s\n",
+			    formats[j].name);
+			triangles_bench(dpy, formats[j].format,
+			    test_ops, num_test_ops, argb32white);
+		}
+	}
+
+	if (enabled_benchmarks & BENCH_GRADIENTS) {
+		begin_group("gradients bench");
+
+		for (j = 0; j < nformats; j++) {
+			if (!shard_begin())
+				continue;
+
+			printf("Beginning gradients benchmark on %s\n",
+			    formats[j].name);
+			gradient_bench(dpy, formats[j].format,
+			    test_ops, num_test_ops);
+		}
+	}
+
+	if (enabled_benchmarks & BENCH_REPEAT) {
+		begin_group("repeat bench");
+
+		for (j = 0; j < nformats; j++) {
+			if (!shard_begin())
+				continue;
+
+			printf("Beginning repeat benchmark on %s\n",
+			    formats[j].name);
+			repeat_bench(dpy, formats[j].format,
+			    test_ops, num_test_ops, argb32red, argb32green);
+		}
+	}
+
+	if ((enabled_benchmarks & BENCH_SCENES) && scene_paths != NULL) {
+		char *paths, *next, *path;
+
+		begin_group("scenes");
+
+		paths = next = strdup(scene_paths);
+		if (paths == NULL)
+			errx(1, "malloc error");
+		while ((path = strsep(&next, ",")) != NULL) {
+			if (!shard_begin())
+				continue;
+
+			printf("Beginning scene %s\n", path);
+			scene_bench(dpy, path);
+		}
+		free(paths);
+	}
+
 	for (i = 0; i < num_colors * nformats; i++) {
 	    free(pictures_1x1[i].name);
 	    free(pictures_10x10[i].name);
@@ -765,14 +1118,25 @@ do {								\
 	}
 	free(formats);
 
+	free_expected_cache();
+	fini_readback(dpy);
+
 	free(test_ops);
 	free(test_src);
 	free(test_mask);
 	free(test_dst);
 
-	printf("%d tests passed of %d total\n", tests_passed, tests_total);
-	printf("Successful Groups:\n");
-	print_tests(stdout, success_mask);
+	if (num_jobs > 1) {
+		shard_report(tests_passed, tests_total, success_mask);
+	} else {
+		latency_report();
+		cpu_report();
+		perf_report();
+		printf("%d tests passed of %d total\n", tests_passed,
+		    tests_total);
+		printf("Successful Groups:\n");
+		print_tests(stdout, success_mask);
+	}
 
 	return tests_passed == tests_total;
 }
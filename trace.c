@@ -0,0 +1,650 @@
+/*
+ * Copyright © 2026 rendercheck contributors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <X11/Xlibint.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/extensions/renderproto.h>
+#include <X11/extensions/shmproto.h>
+#include <xcb/xcbext.h>
+/* Xlibint.h has its own min() and max(). */
+#undef min
+#undef max
+#include "rendercheck.h"
+
+/* With --record, every request rendercheck sends through Xlib is copied as it
+ * is flushed into a trace file, along with the readbacks it sends through XCB
+ * directly, so that the same request stream can be sent again later with
+ * --replay, without the verification, against any server.
+ *
+ * The file starts with a trace_header, giving the resource IDs and extension
+ * opcodes of the recording connection and the Render formats of its server,
+ * then a trace_format for each of those formats.  Then come trace_records,
+ * each followed by the complete requests flushed at that time, as sent.
+ *
+ * On replay, XIDs, extension opcodes and formats are translated to those of
+ * the new connection.  Replies are waited for, so readbacks and XSync()s
+ * still cost a round trip.  MIT-SHM pixmaps become plain pixmaps, and the
+ * other MIT-SHM requests are dropped, since the shared memory is gone.
+ */
+
+#define TRACE_MAGIC		"RCTRACE1"
+#define TRACE_BYTE_ORDER	0x01020304
+
+struct trace_header {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t resource_base, resource_mask, root;
+	uint32_t render_major, shm_major;
+	uint32_t num_formats;
+};
+
+struct trace_format {
+	uint32_t id;
+	uint8_t type, depth;
+	uint16_t pad;
+	uint16_t red, red_mask, green, green_mask;
+	uint16_t blue, blue_mask, alpha, alpha_mask;
+};
+
+struct trace_record {
+	/* Microseconds since recording started. */
+	uint32_t time;
+	uint32_t length;
+};
+
+char *record_path;
+char *replay_path;
+bool replay_paced;
+
+static FILE *trace_file;
+static double trace_start;
+static char *pending;
+static size_t pending_length, pending_allocated;
+
+/* Returns the length in bytes of the request at data, or 0 if not enough of
+ * it is there to tell.
+ */
+static size_t
+request_length(const char *data, size_t available)
+{
+	uint16_t length;
+	uint32_t big_length;
+
+	if (available < 4)
+		return 0;
+	memcpy(&length, data + 2, sizeof(length));
+	if (length != 0)
+		return length * 4;
+
+	/* BIG-REQUESTS puts the real length after the header. */
+	if (available < 8)
+		return 0;
+	memcpy(&big_length, data + 4, sizeof(big_length));
+	return (size_t)big_length * 4;
+}
+
+static void
+write_record(const char *data, size_t length)
+{
+	struct trace_record record;
+
+	record.time = (get_time() - trace_start) * 1e6;
+	record.length = length;
+	if (fwrite(&record, sizeof(record), 1, trace_file) != 1 ||
+	    fwrite(data, length, 1, trace_file) != 1)
+		errx(1, "%s: %s", record_path, strerror(errno));
+}
+
+/* Called by Xlib with each piece of data it sends, which may end partway
+ * through a request.  Complete requests are written out, and the rest kept
+ * for the next call.
+ */
+static void
+trace_before_flush(Display *dpy, XExtCodes *codes, const char *data,
+		   long length)
+{
+	size_t complete = 0, size;
+
+	(void)dpy;
+	(void)codes;
+
+	if (trace_file == NULL || length == 0)
+		return;
+
+	if (pending_length + length > pending_allocated) {
+		pending_allocated = max(pending_allocated * 2,
+		    pending_length + length);
+		pending = realloc(pending, pending_allocated);
+		if (pending == NULL)
+			errx(1, "malloc error");
+	}
+	memcpy(pending + pending_length, data, length);
+	pending_length += length;
+
+	while ((size = request_length(pending + complete,
+				      pending_length - complete)) != 0 &&
+	       complete + size <= pending_length)
+		complete += size;
+
+	if (complete == 0)
+		return;
+
+	write_record(pending, complete);
+	pending_length -= complete;
+	memmove(pending, pending + complete, pending_length);
+}
+
+/* Starts recording the requests sent on dpy to record_path, if set. */
+void
+trace_init(Display *dpy)
+{
+	xcb_connection_t *c = XGetXCBConnection(dpy);
+	const xcb_setup_t *setup = xcb_get_setup(c);
+	struct trace_header header;
+	XRenderPictFormat *format;
+	XExtCodes *codes;
+	int major, event, error, i;
+
+	if (record_path == NULL)
+		return;
+
+	trace_file = fopen(record_path, "w");
+	if (trace_file == NULL)
+		errx(1, "%s: %s", record_path, strerror(errno));
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+	header.byte_order = TRACE_BYTE_ORDER;
+	header.resource_base = setup->resource_id_base;
+	header.resource_mask = setup->resource_id_mask;
+	header.root = DefaultRootWindow(dpy);
+	if (XQueryExtension(dpy, "RENDER", &major, &event, &error))
+		header.render_major = major;
+	if (XQueryExtension(dpy, "MIT-SHM", &major, &event, &error))
+		header.shm_major = major;
+	while (XRenderFindFormat(dpy, 0, NULL, header.num_formats) != NULL)
+		header.num_formats++;
+	if (fwrite(&header, sizeof(header), 1, trace_file) != 1)
+		errx(1, "%s: %s", record_path, strerror(errno));
+
+	for (i = 0; (format = XRenderFindFormat(dpy, 0, NULL, i)) != NULL;
+	     i++) {
+		struct trace_format f;
+
+		memset(&f, 0, sizeof(f));
+		f.id = format->id;
+		f.type = format->type;
+		f.depth = format->depth;
+		f.red = format->direct.red;
+		f.red_mask = format->direct.redMask;
+		f.green = format->direct.green;
+		f.green_mask = format->direct.greenMask;
+		f.blue = format->direct.blue;
+		f.blue_mask = format->direct.blueMask;
+		f.alpha = format->direct.alpha;
+		f.alpha_mask = format->direct.alphaMask;
+		if (fwrite(&f, sizeof(f), 1, trace_file) != 1)
+			errx(1, "%s: %s", record_path, strerror(errno));
+	}
+
+	/* Everything sent before this point is left out. */
+	XSync(dpy, False);
+	trace_start = get_time();
+	codes = XAddExtension(dpy);
+	XESetBeforeFlush(dpy, codes->extension, trace_before_flush);
+}
+
+void
+trace_fini(Display *dpy)
+{
+	if (trace_file == NULL)
+		return;
+
+	XFlush(dpy);
+	if (fclose(trace_file) != 0)
+		errx(1, "%s: %s", record_path, strerror(errno));
+	trace_file = NULL;
+	free(pending);
+	pending = NULL;
+	pending_length = pending_allocated = 0;
+}
+
+/* Records a GetImage in place of a readback about to be sent through XCB,
+ * after flushing what Xlib has queued so that the order is kept.
+ */
+void
+trace_get_image(Display *dpy, Drawable d, int x, int y, int w, int h)
+{
+	xGetImageReq req;
+
+	if (trace_file == NULL)
+		return;
+
+	XFlush(dpy);
+	memset(&req, 0, sizeof(req));
+	req.reqType = X_GetImage;
+	req.format = ZPixmap;
+	req.length = sz_xGetImageReq / 4;
+	req.drawable = d;
+	req.x = x;
+	req.y = y;
+	req.width = w;
+	req.height = h;
+	req.planeMask = ~0U;
+	write_record((const char *)&req, sizeof(req));
+}
+
+/* Records a GetInputFocus about to be sent through XCB as a fence. */
+void
+trace_get_input_focus(Display *dpy)
+{
+	xReq req;
+
+	if (trace_file == NULL)
+		return;
+
+	XFlush(dpy);
+	memset(&req, 0, sizeof(req));
+	req.reqType = X_GetInputFocus;
+	req.length = sz_xReq / 4;
+	write_record((const char *)&req, sizeof(req));
+}
+
+/* Where the resource IDs and format IDs are in each request that can be
+ * replayed.  values is where the value mask of a picture attribute list is,
+ * for the IDs in the list.
+ */
+struct request_layout {
+	bool known;
+	bool reply;
+	uint8_t xids[4];
+	uint8_t format;
+	uint8_t values;
+};
+
+static const struct request_layout core_layouts[128] = {
+	[X_CreateWindow] =		{ true, false, { 4, 8 } },
+	[X_ChangeWindowAttributes] =	{ true, false, { 4 } },
+	[X_GetWindowAttributes] =	{ true, true, { 4 } },
+	[X_MapWindow] =			{ true, false, { 4 } },
+	[X_GetGeometry] =		{ true, true, { 4 } },
+	[X_GetInputFocus] =		{ true, true },
+	[X_CreatePixmap] =		{ true, false, { 4, 8 } },
+	[X_FreePixmap] =		{ true, false, { 4 } },
+	[X_CreateGC] =			{ true, false, { 4, 8 } },
+	[X_ChangeGC] =			{ true, false, { 4 } },
+	[X_FreeGC] =			{ true, false, { 4 } },
+	[X_PolyFillRectangle] =		{ true, false, { 4, 8 } },
+	[X_PutImage] =			{ true, false, { 4, 8 } },
+	[X_GetImage] =			{ true, true, { 4 } },
+	[X_QueryExtension] =		{ true, true },
+};
+
+static const struct request_layout render_layouts[] = {
+	[X_RenderQueryVersion] =	{ true, true },
+	[X_RenderQueryPictFormats] =	{ true, true },
+	[X_RenderCreatePicture] =	{ true, false, { 4, 8 }, 12, 16 },
+	[X_RenderChangePicture] =	{ true, false, { 4 }, 0, 8 },
+	[X_RenderSetPictureClipRectangles] = { true, false, { 4 } },
+	[X_RenderFreePicture] =		{ true, false, { 4 } },
+	[X_RenderComposite] =		{ true, false, { 8, 12, 16 } },
+	[X_RenderTrapezoids] =		{ true, false, { 8, 12 }, 16 },
+	[X_RenderTriangles] =		{ true, false, { 8, 12 }, 16 },
+	[X_RenderTriStrip] =		{ true, false, { 8, 12 }, 16 },
+	[X_RenderTriFan] =		{ true, false, { 8, 12 }, 16 },
+	[X_RenderCreateGlyphSet] =	{ true, false, { 4 }, 8 },
+	[X_RenderFreeGlyphSet] =	{ true, false, { 4 } },
+	[X_RenderAddGlyphs] =		{ true, false, { 4 } },
+	[X_RenderFreeGlyphs] =		{ true, false, { 4 } },
+	[X_RenderCompositeGlyphs8] =	{ true, false, { 8, 12, 20 }, 16 },
+	[X_RenderCompositeGlyphs16] =	{ true, false, { 8, 12, 20 }, 16 },
+	[X_RenderCompositeGlyphs32] =	{ true, false, { 8, 12, 20 }, 16 },
+	[X_RenderFillRectangles] =	{ true, false, { 8 } },
+	[X_RenderSetPictureTransform] =	{ true, false, { 4 } },
+	[X_RenderQueryFilters] =	{ true, true, { 4 } },
+	[X_RenderSetPictureFilter] =	{ true, false, { 4 } },
+	[X_RenderCreateSolidFill] =	{ true, false, { 4 } },
+	[X_RenderCreateLinearGradient] = { true, false, { 4 } },
+	[X_RenderCreateRadialGradient] = { true, false, { 4 } },
+	[X_RenderCreateConicalGradient] = { true, false, { 4 } },
+};
+
+struct replay {
+	Display *dpy;
+	xcb_connection_t *c;
+	struct trace_header header;
+	struct trace_format *formats;
+	uint32_t *format_ids;
+	uint32_t resource_base, resource_mask, root;
+	int render_major;
+	int sent, skipped;
+};
+
+static int replay_errors;
+
+static int
+replay_error_handler(Display *dpy, XErrorEvent *e)
+{
+	(void)dpy;
+	(void)e;
+	replay_errors++;
+	return 0;
+}
+
+static uint32_t
+get_card32(const char *req, int offset)
+{
+	uint32_t v;
+
+	memcpy(&v, req + offset, sizeof(v));
+	return v;
+}
+
+static void
+put_card32(char *req, int offset, uint32_t v)
+{
+	memcpy(req + offset, &v, sizeof(v));
+}
+
+static uint32_t
+remap_xid(const struct replay *r, uint32_t xid)
+{
+	if (xid == 0)
+		return 0;
+	if (xid == r->header.root)
+		return r->root;
+	if ((xid & ~r->header.resource_mask) != r->header.resource_base)
+		return xid;
+	if ((xid & r->header.resource_mask & ~r->resource_mask) != 0)
+		errx(1, "XID 0x%x doesn't fit this connection's ID space", xid);
+	return r->resource_base | (xid & r->header.resource_mask);
+}
+
+/* Remaps the alpha map and clip mask in the picture attribute list whose
+ * value mask is at offset.
+ */
+static void
+remap_picture_values(const struct replay *r, char *req, size_t length,
+		     int offset)
+{
+	uint32_t mask = get_card32(req, offset);
+	int bit;
+
+	offset += 4;
+	for (bit = 0; bit < 32 && offset + 4 <= (int)length; bit++) {
+		if (!(mask & (1u << bit)))
+			continue;
+		if ((1u << bit) == CPAlphaMap || (1u << bit) == CPClipMask) {
+			put_card32(req, offset,
+				   remap_xid(r, get_card32(req, offset)));
+		}
+		offset += 4;
+	}
+}
+
+static uint32_t
+remap_format(const struct replay *r, uint32_t id)
+{
+	uint32_t i;
+
+	if (id == 0)
+		return 0;
+	for (i = 0; i < r->header.num_formats; i++) {
+		if (r->formats[i].id == id) {
+			if (r->format_ids[i] == 0)
+				errx(1, "format %d/%d of the trace not "
+				     "supported by the server",
+				     r->formats[i].type, r->formats[i].depth);
+			return r->format_ids[i];
+		}
+	}
+	return id;
+}
+
+static void
+send_request(struct replay *r, char *req, size_t length, bool reply)
+{
+	xcb_protocol_request_t request = { 1, NULL, 0, !reply };
+	xcb_generic_error_t *error = NULL;
+	struct iovec vector[3];
+	unsigned int sequence;
+
+	/* xcb_send_request() may use the two entries before the request. */
+	vector[2].iov_base = req;
+	vector[2].iov_len = length;
+	sequence = xcb_send_request(r->c, XCB_REQUEST_RAW, &vector[2],
+				    &request);
+	if (sequence == 0)
+		errx(1, "failed to send request");
+	r->sent++;
+
+	if (reply) {
+		free(xcb_wait_for_reply(r->c, sequence, &error));
+		if (error != NULL) {
+			replay_errors++;
+			free(error);
+		}
+	}
+}
+
+/* Translates the request at req to the replay connection and sends it. */
+static void
+replay_request(struct replay *r, char *req, size_t length)
+{
+	const struct request_layout *layout = NULL;
+	uint8_t major = req[0], minor = req[1];
+	uint16_t short_length;
+	int i, extra;
+
+	if (major < 128) {
+		layout = &core_layouts[major];
+	} else if (major == r->header.render_major) {
+		if (minor < ARRAY_SIZE(render_layouts))
+			layout = &render_layouts[minor];
+		req[0] = r->render_major;
+	} else if (major == r->header.shm_major && minor == X_ShmCreatePixmap) {
+		xShmCreatePixmapReq shm;
+		xCreatePixmapReq pix;
+
+		memcpy(&shm, req, sizeof(shm));
+		memset(&pix, 0, sizeof(pix));
+		pix.reqType = X_CreatePixmap;
+		pix.depth = shm.depth;
+		pix.length = sz_xCreatePixmapReq / 4;
+		pix.pid = remap_xid(r, shm.pid);
+		pix.drawable = remap_xid(r, shm.drawable);
+		pix.width = shm.width;
+		pix.height = shm.height;
+		send_request(r, (char *)&pix, sizeof(pix), false);
+		return;
+	}
+
+	if (layout == NULL || !layout->known) {
+		r->skipped++;
+		return;
+	}
+
+	/* The layouts are of the usual encoding, and BIG-REQUESTS moves
+	 * everything after the header along by the 32-bit length.
+	 */
+	memcpy(&short_length, req + 2, sizeof(short_length));
+	extra = short_length == 0 ? 4 : 0;
+
+	for (i = 0; i < 4 && layout->xids[i] != 0; i++) {
+		int offset = layout->xids[i] + extra;
+
+		put_card32(req, offset, remap_xid(r, get_card32(req, offset)));
+	}
+	if (layout->format != 0) {
+		int offset = layout->format + extra;
+
+		put_card32(req, offset,
+			   remap_format(r, get_card32(req, offset)));
+	}
+	if (layout->values != 0)
+		remap_picture_values(r, req, length, layout->values + extra);
+
+	send_request(r, req, length, layout->reply);
+}
+
+static void
+read_trace(void *data, size_t size, FILE *file)
+{
+	if (fread(data, size, 1, file) != 1)
+		errx(1, "%s: truncated trace", replay_path);
+}
+
+/* Matches the formats of the trace to those of the replay server. */
+static void
+map_formats(struct replay *r, FILE *file)
+{
+	uint32_t i;
+
+	r->formats = malloc(sizeof(*r->formats) * r->header.num_formats);
+	r->format_ids = calloc(r->header.num_formats, sizeof(uint32_t));
+	if (r->formats == NULL || r->format_ids == NULL)
+		errx(1, "malloc error");
+
+	for (i = 0; i < r->header.num_formats; i++) {
+		struct trace_format *f = &r->formats[i];
+		XRenderPictFormat templ, *format;
+
+		read_trace(f, sizeof(*f), file);
+
+		memset(&templ, 0, sizeof(templ));
+		templ.type = f->type;
+		templ.depth = f->depth;
+		templ.direct.red = f->red;
+		templ.direct.redMask = f->red_mask;
+		templ.direct.green = f->green;
+		templ.direct.greenMask = f->green_mask;
+		templ.direct.blue = f->blue;
+		templ.direct.blueMask = f->blue_mask;
+		templ.direct.alpha = f->alpha;
+		templ.direct.alphaMask = f->alpha_mask;
+		format = XRenderFindFormat(r->dpy, PictFormatType |
+		    PictFormatDepth | PictFormatRed | PictFormatRedMask |
+		    PictFormatGreen | PictFormatGreenMask | PictFormatBlue |
+		    PictFormatBlueMask | PictFormatAlpha | PictFormatAlphaMask,
+		    &templ, 0);
+		if (format != NULL)
+			r->format_ids[i] = format->id;
+	}
+}
+
+/* Sends the requests of the trace at replay_path to display, as fast as
+ * possible or, with replay_paced, no sooner than they were recorded.
+ * Returns the exit status for the program.  X errors are counted but don't
+ * fail the replay, since some tests, such as bug7366, cause them on purpose.
+ */
+int
+replay_trace(const char *display)
+{
+	struct trace_record record;
+	struct replay r;
+	const xcb_setup_t *setup;
+	char *data = NULL;
+	size_t allocated = 0, offset, size;
+	double start, elapsed;
+	int major, event, error;
+	FILE *file;
+
+	memset(&r, 0, sizeof(r));
+	r.dpy = XOpenDisplay(display);
+	if (r.dpy == NULL)
+		errx(1, "Couldn't open display.");
+	if (!XQueryExtension(r.dpy, "RENDER", &major, &event, &error))
+		errx(1, "Render extension missing.");
+	r.render_major = major;
+	r.c = XGetXCBConnection(r.dpy);
+	setup = xcb_get_setup(r.c);
+	r.resource_base = setup->resource_id_base;
+	r.resource_mask = setup->resource_id_mask;
+	r.root = DefaultRootWindow(r.dpy);
+	/* Make sure BIG-REQUESTS is enabled for any big requests recorded. */
+	xcb_get_maximum_request_length(r.c);
+
+	file = fopen(replay_path, "r");
+	if (file == NULL)
+		errx(1, "%s: %s", replay_path, strerror(errno));
+	read_trace(&r.header, sizeof(r.header), file);
+	if (memcmp(r.header.magic, TRACE_MAGIC, sizeof(r.header.magic)) != 0)
+		errx(1, "%s: not a rendercheck trace", replay_path);
+	if (r.header.byte_order != TRACE_BYTE_ORDER)
+		errx(1, "%s: recorded on a client of the other byte order",
+		     replay_path);
+	map_formats(&r, file);
+
+	XSetErrorHandler(replay_error_handler);
+	XSync(r.dpy, False);
+	start = get_time();
+
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		if (record.length > allocated) {
+			allocated = record.length;
+			data = realloc(data, allocated);
+			if (data == NULL)
+				errx(1, "malloc error");
+		}
+		read_trace(data, record.length, file);
+
+		if (replay_paced) {
+			double wait = start + record.time / 1e6 - get_time();
+
+			if (wait > 0) {
+				struct timespec ts;
+
+				xcb_flush(r.c);
+				ts.tv_sec = wait;
+				ts.tv_nsec = (wait - ts.tv_sec) * 1e9;
+				nanosleep(&ts, NULL);
+			}
+		}
+
+		for (offset = 0; offset < record.length; offset += size) {
+			size = request_length(data + offset,
+					      record.length - offset);
+			if (size == 0 || offset + size > record.length)
+				errx(1, "%s: corrupt trace", replay_path);
+			replay_request(&r, data + offset, size);
+		}
+	}
+
+	XSync(r.dpy, False);
+	elapsed = get_time() - start;
+	printf("Replayed %d requests in %.3f s, %d skipped, %d errors\n",
+	       r.sent, elapsed, r.skipped, replay_errors);
+
+	fclose(file);
+	free(data);
+	free(r.formats);
+	free(r.format_ids);
+	XCloseDisplay(r.dpy);
+
+	return 0;
+}